@@ -0,0 +1,318 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Microbenchmarks of the calls to the runtime that are added to instrumented
+// code. Only software counters are used so this can be run on any Linux
+// machine, including virtual machines without access to the PMU. The results
+// are written as JSON Lines, one object per measurement
+
+#include "common/API.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+// These are counted by the kernel. The names are understood by both the PAPI
+// and the perf_event_open backends
+static const char* const softwareCounters[] = {
+    "perf::TASK-CLOCK",
+    "perf::CONTEXT-SWITCHES",
+    "perf::CPU-MIGRATIONS",
+    "perf::PAGE-FAULTS",
+    "perf::MINOR-FAULTS",
+    "perf::MAJOR-FAULTS",
+    "perf::ALIGNMENT-FAULTS",
+    "perf::EMULATION-FAULTS",
+};
+
+// Functions registered with the runtime as if they were in an instrumented
+// shared object. The IDs are never reused so that every benchmark starts
+// without any state in the runtime. The module is unregistered when it is
+// destroyed, as if the shared object had been unloaded, since the next one
+// may be at the same address
+class Module {
+protected:
+  static FunctionID nextID;
+
+  std::vector<const char*> counters;
+  std::vector<hwc::RTFuncMeta> funcs;
+  hwc::RTMeta meta;
+
+public:
+  Module(unsigned numFuncs, const std::vector<const char*>& counters)
+      : counters(counters) {
+    for(unsigned i = 0; i < numFuncs; i++)
+      funcs.push_back({nextID++,
+                       this->counters.data(),
+                       static_cast<unsigned>(this->counters.size()),
+                       "bench",
+                       "hwc::bench"});
+    meta = {funcs.data(),
+            funcs.data() + funcs.size(),
+            nullptr,
+            nullptr,
+            nullptr,
+            nullptr};
+  }
+
+  Module(const Module&) = delete;
+  Module(Module&&) = delete;
+
+  ~Module() {
+    HWC_UNREGISTER_MODULE(&meta);
+  }
+
+  void load() {
+    HWC_REGISTER_MODULE(&meta);
+  }
+
+  FunctionID getID(unsigned i) const {
+    return funcs[i].id;
+  }
+};
+
+FunctionID Module::nextID = 1;
+
+struct Options {
+  unsigned iterations;
+  unsigned threads;
+  std::string output;
+
+  Options()
+      : iterations(1000000),
+        threads(std::max(1u, std::thread::hardware_concurrency())) {
+    ;
+  }
+};
+
+class Results {
+protected:
+  std::ostringstream os;
+
+public:
+  // The parameters are a list of "key": value pairs
+  void add(const std::string& name,
+           const std::string& params,
+           unsigned long long ops,
+           double ns) {
+    os << "{\"benchmark\":\"" << name << "\"," << params
+       << ",\"ops\":" << ops << ",\"ns\":" << static_cast<long long>(ns)
+       << ",\"ns_per_op\":" << ns / ops << "}\n";
+    std::cerr << name << " " << params << ": " << ns / ops << " ns/op\n";
+  }
+
+  void write(const std::string& file) const {
+    if(file.empty() or file == "-") {
+      std::cout << os.str();
+    } else {
+      std::ofstream of(file.c_str());
+      of << os.str();
+    }
+  }
+};
+
+static std::string param(const char* key, unsigned long long val) {
+  return std::string("\"") + key + "\":" + std::to_string(val);
+}
+
+static double elapsed(Clock::time_point start) {
+  return std::chrono::duration<double, std::nano>(Clock::now() - start)
+      .count();
+}
+
+// The first call for a function creates its stats. That is measured
+// separately
+static void warmup(const Module& module, unsigned numFuncs) {
+  for(unsigned i = 0; i < numFuncs; i++) {
+    HWC_ENTER_FUNC(module.getID(i));
+    HWC_EXIT_FUNC(module.getID(i));
+  }
+}
+
+static void benchEnterExit(const Options& opts, Results& results) {
+  std::vector<const char*> available(std::begin(softwareCounters),
+                                     std::end(softwareCounters));
+  for(unsigned n = 0; n <= available.size(); n = n ? n * 2 : 1) {
+    std::vector<const char*> counters(available.begin(),
+                                      available.begin() + n);
+    Module module(1, counters);
+    module.load();
+    warmup(module, 1);
+
+    FunctionID id = module.getID(0);
+    Clock::time_point start = Clock::now();
+    for(unsigned i = 0; i < opts.iterations; i++) {
+      HWC_ENTER_FUNC(id);
+      HWC_EXIT_FUNC(id);
+    }
+    results.add("enter_exit",
+                param("counters", n) + "," + param("threads", 1),
+                opts.iterations,
+                elapsed(start));
+  }
+}
+
+static void benchNested(const Options& opts, Results& results) {
+  for(unsigned depth = 1; depth <= 64; depth *= 4) {
+    Module module(depth, {});
+    module.load();
+    warmup(module, depth);
+
+    unsigned reps = std::max(1u, opts.iterations / depth);
+    Clock::time_point start = Clock::now();
+    for(unsigned i = 0; i < reps; i++) {
+      for(unsigned d = 0; d < depth; d++)
+        HWC_ENTER_FUNC(module.getID(d));
+      for(unsigned d = depth; d > 0; d--)
+        HWC_EXIT_FUNC(module.getID(d - 1));
+    }
+    results.add("nested",
+                param("depth", depth) + "," + param("threads", 1),
+                static_cast<unsigned long long>(reps) * depth,
+                elapsed(start));
+  }
+}
+
+static void benchRecursion(const Options& opts, Results& results) {
+  for(unsigned depth = 1; depth <= 64; depth *= 4) {
+    Module module(1, {});
+    module.load();
+    warmup(module, 1);
+
+    FunctionID id = module.getID(0);
+    unsigned reps = std::max(1u, opts.iterations / depth);
+    Clock::time_point start = Clock::now();
+    for(unsigned i = 0; i < reps; i++) {
+      for(unsigned d = 0; d < depth; d++)
+        HWC_ENTER_FUNC(id);
+      for(unsigned d = 0; d < depth; d++)
+        HWC_EXIT_FUNC(id);
+    }
+    results.add("recursion",
+                param("depth", depth) + "," + param("threads", 1),
+                static_cast<unsigned long long>(reps) * depth,
+                elapsed(start));
+  }
+}
+
+// Every thread either calls the same function or a function of its own. The
+// time reported is the wall time of the slowest thread
+static void benchThreads(const Options& opts, Results& results) {
+  for(bool shared : {true, false}) {
+    for(unsigned threads = 1; threads <= opts.threads; threads *= 2) {
+      Module module(shared ? 1 : threads, {});
+      module.load();
+
+      std::vector<double> times(threads);
+      std::vector<std::thread> workers;
+      for(unsigned t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+          FunctionID id = module.getID(shared ? 0 : t);
+          HWC_ENTER_FUNC(id);
+          HWC_EXIT_FUNC(id);
+
+          Clock::time_point start = Clock::now();
+          for(unsigned i = 0; i < opts.iterations; i++) {
+            HWC_ENTER_FUNC(id);
+            HWC_EXIT_FUNC(id);
+          }
+          times[t] = elapsed(start);
+        });
+      }
+      for(std::thread& worker : workers)
+        worker.join();
+
+      results.add(shared ? "threads_shared" : "threads_distinct",
+                  param("threads", threads),
+                  opts.iterations,
+                  *std::max_element(times.begin(), times.end()));
+    }
+  }
+}
+
+// The cost of registering a module and of the first call of each of its
+// functions, which is when the runtime looks up its metadata and creates its
+// stats
+static void benchStartup(Results& results) {
+  for(unsigned numFuncs = 100; numFuncs <= 100000; numFuncs *= 10) {
+    Module module(numFuncs, {});
+
+    Clock::time_point start = Clock::now();
+    module.load();
+    double load = elapsed(start);
+    results.add("register", param("functions", numFuncs), 1, load);
+
+    start = Clock::now();
+    warmup(module, numFuncs);
+    results.add("first_call",
+                param("functions", numFuncs),
+                numFuncs,
+                elapsed(start));
+  }
+}
+
+static bool parseArgs(int argc, char* argv[], Options& opts) {
+  for(int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if(arg == "-i" and i + 1 < argc)
+      opts.iterations = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+    else if(arg == "-t" and i + 1 < argc)
+      opts.threads = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+    else if(arg == "-o" and i + 1 < argc)
+      opts.output = argv[++i];
+    else
+      return false;
+  }
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  Options opts;
+  if(not parseArgs(argc, argv, opts)) {
+    std::cerr << "Usage: " << argv[0] << " [-i <iterations>] "
+              << "[-t <max threads>] [-o <output>]\n";
+    return 1;
+  }
+
+  // The runtime is dormant unless the output has been requested. That is
+  // decided when it is loaded, so the benchmark has to be restarted
+  if(not std::getenv("HWCINSTR")) {
+    setenv("HWCINSTR", "/dev/null", 1);
+    execv("/proc/self/exe", argv);
+    std::cerr << "Could not restart with HWCINSTR set\n";
+    return 1;
+  }
+
+  Results results;
+  benchEnterExit(opts, results);
+  benchNested(opts, results);
+  benchRecursion(opts, results);
+  benchThreads(opts, results);
+  benchStartup(results);
+  results.write(opts.output);
+
+  return 0;
+}
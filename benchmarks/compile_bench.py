@@ -0,0 +1,138 @@
+#!/usr/bin/env python3
+
+# Measures the compile-time cost of the plugin on synthetic translation units.
+# Every unit is compiled without the plugin and with it in each of the
+# instrumentation modes. The time spent in each phase of the plugin is taken
+# from the report that it writes. The results are written as JSON Lines
+
+import argparse
+import json
+import os
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+import generate_tu
+
+PHASES = ['conf', 'consumer', 'generate_wrappers', 'generate_symbols',
+          'mark_functions', 'instrument_functions', 'instrument_calls',
+          'apply_profile']
+
+# Each configuration is (lang, functions, templates, instantiations, lambdas)
+CONFIGS = [
+    ('c', 100, 0, 0, 0),
+    ('c', 1000, 0, 0, 0),
+    ('c', 5000, 0, 0, 0),
+    ('c++', 1000, 0, 0, 0),
+    ('c++', 100, 100, 10, 0),
+    ('c++', 100, 20, 100, 0),
+    ('c++', 100, 0, 0, 1000),
+]
+
+
+def plugin_args(plugin, conf, mode, report):
+    if mode == 'baseline':
+        return []
+
+    def arg(a):
+        return ['-Xclang', '-plugin-arg-hwcinstr', '-Xclang', a]
+
+    args = ['-Xclang', '-load', '-Xclang', plugin]
+    args += arg('-conf') + arg(conf)
+    args += arg('-time-report') + arg(report)
+    if mode == 'late':
+        args += arg('-late')
+    return args
+
+
+def compile_once(compiler, src, extra, opt):
+    cmd = [compiler, opt, '-c', src, '-o', os.devnull] + extra
+    start = time.perf_counter_ns()
+    subprocess.run(cmd, check=True)
+    return time.perf_counter_ns() - start
+
+
+def read_report(report):
+    phases = {p: [] for p in PHASES}
+    if os.path.exists(report):
+        with open(report) as f:
+            for line in f:
+                entry = json.loads(line)
+                for p in PHASES:
+                    phases[p].append(entry.get(p, 0))
+        os.remove(report)
+    return {p: int(statistics.median(v)) if v else 0
+            for p, v in phases.items()}
+
+
+def run(args, tmpdir, out):
+    for lang, functions, templates, instantiations, lambdas in CONFIGS:
+        compiler = args.clang if lang == 'c' else args.clangxx
+        src, conf = generate_tu.generate(tmpdir, 'bench', lang, functions,
+                                         templates, instantiations, lambdas,
+                                         args.select)
+        report = os.path.join(tmpdir, 'report.jsonl')
+
+        baseline = None
+        for mode in ['baseline', 'wrapper', 'late']:
+            extra = plugin_args(args.plugin, conf, mode, report)
+            times = [compile_once(compiler, src, extra, args.opt)
+                     for _ in range(args.repeat)]
+            wall = int(statistics.median(times))
+            if mode == 'baseline':
+                baseline = wall
+
+            result = {
+                'lang': lang,
+                'functions': functions,
+                'templates': templates,
+                'instantiations': instantiations,
+                'lambdas': lambdas,
+                'select': args.select,
+                'opt': args.opt,
+                'mode': mode,
+                'wall_ns': wall,
+                'overhead': wall / baseline - 1,
+            }
+            if mode != 'baseline':
+                result['phases'] = read_report(report)
+
+            out.write(json.dumps(result) + '\n')
+            out.flush()
+            print('{0} {1} {2}: {3:.1f} ms ({4:+.1%})'.format(
+                lang, functions + templates * instantiations + lambdas,
+                mode, wall / 1e6, result['overhead']), file=sys.stderr)
+
+
+def main():
+    ap = argparse.ArgumentParser('Compile-time benchmark of the plugin')
+    ap.add_argument('--clang', type=str, required=True,
+                    help='The C compiler')
+    ap.add_argument('--clangxx', type=str, required=True,
+                    help='The C++ compiler')
+    ap.add_argument('--plugin', type=str, required=True,
+                    help='Path to the plugin')
+    ap.add_argument('--output', type=str, default='-',
+                    help='File to which the results are written')
+    ap.add_argument('--repeat', type=int, default=5,
+                    help='Number of times each file is compiled')
+    ap.add_argument('--opt', type=str, default='-O2',
+                    help='Optimization level')
+    ap.add_argument('--select', choices=generate_tu.SELECTIONS,
+                    default='all',
+                    help='Functions to select in the config file')
+    args = ap.parse_args()
+
+    with tempfile.TemporaryDirectory() as tmpdir:
+        if args.output == '-':
+            run(args, tmpdir, sys.stdout)
+        else:
+            with open(args.output, 'w') as out:
+                run(args, tmpdir, out)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+
+# Generates a synthetic translation unit and a config file selecting some of
+# its functions for instrumentation. It is used to measure the compile-time
+# cost of the plugin
+
+import argparse
+import os
+import sys
+
+# The functions in the config file
+SELECTIONS = ['all', 'half', 'templates', 'lambdas', 'none']
+
+
+def generate_source(lang, functions, templates, instantiations, lambdas):
+    lines = []
+    for i in range(functions):
+        lines.extend([
+            'int func{0}(int x) {{'.format(i),
+            '  int s = 0;',
+            '  for(int j = 0; j < x; j++)',
+            '    s += j * {0};'.format(i + 1),
+            '  return s;',
+            '}',
+            ''])
+
+    if lang == 'c':
+        return '\n'.join(lines)
+
+    for i in range(templates):
+        lines.extend([
+            'template <int K>',
+            'int tmpl{0}(int x) {{'.format(i),
+            '  return x * K + {0};'.format(i),
+            '}',
+            ''])
+        lines.append('int use{0}(int x) {{'.format(i))
+        lines.append('  int s = 0;')
+        for k in range(instantiations):
+            lines.append('  s += tmpl{0}<{1}>(x);'.format(i, k))
+        lines.extend(['  return s;', '}', ''])
+
+    for i in range(lambdas):
+        lines.extend([
+            'int lambda{0}(int x) {{'.format(i),
+            '  auto f = [x](int y) {{ return x * y + {0}; }};'.format(i),
+            '  return f(x);',
+            '}',
+            ''])
+
+    return '\n'.join(lines)
+
+
+def generate_conf(lang, functions, templates, lambdas, select):
+    names = []
+    if select in ('all', 'half'):
+        step = 2 if select == 'half' else 1
+        names.extend(['func{0}'.format(i) for i in range(0, functions, step)])
+        if lang != 'c':
+            names.extend(['tmpl{0}'.format(i)
+                          for i in range(0, templates, step)])
+            names.extend(['lambda{0}'.format(i)
+                          for i in range(0, lambdas, step)])
+    elif select == 'templates' and lang != 'c':
+        names.extend(['tmpl{0}'.format(i) for i in range(templates)])
+    elif select == 'lambdas' and lang != 'c':
+        # The call operators of all the lambdas have the same name
+        names.append('operator()')
+
+    # The config file must name at least one function
+    if not names:
+        names.append('__hwcinstr_bench_none')
+
+    return 'functions:\n' + ''.join('  - {0}\n'.format(n) for n in names)
+
+
+def generate(outdir, name, lang='c++', functions=100, templates=0,
+             instantiations=0, lambdas=0, select='all'):
+    """Writes the source and config files and returns their paths"""
+    ext = 'c' if lang == 'c' else 'cpp'
+    src = os.path.join(outdir, '{0}.{1}'.format(name, ext))
+    conf = os.path.join(outdir, '{0}.yaml'.format(name))
+    with open(src, 'w') as f:
+        f.write(generate_source(lang, functions, templates, instantiations,
+                                lambdas))
+    with open(conf, 'w') as f:
+        f.write(generate_conf(lang, functions, templates, lambdas, select))
+    return src, conf
+
+
+def main():
+    ap = argparse.ArgumentParser('Generate a synthetic translation unit')
+    ap.add_argument('--lang', choices=['c', 'c++'], default='c++',
+                    help='Language of the generated source')
+    ap.add_argument('--functions', type=int, default=100,
+                    help='Number of plain functions')
+    ap.add_argument('--templates', type=int, default=0,
+                    help='Number of function templates (C++ only)')
+    ap.add_argument('--instantiations', type=int, default=0,
+                    help='Number of instantiations of each template')
+    ap.add_argument('--lambdas', type=int, default=0,
+                    help='Number of lambdas (C++ only)')
+    ap.add_argument('--select', choices=SELECTIONS, default='all',
+                    help='Functions to select in the config file')
+    ap.add_argument('--output-dir', type=str, default='.',
+                    help='Directory in which to write the files')
+    ap.add_argument('--name', type=str, default='bench',
+                    help='Base name of the generated files')
+    args = ap.parse_args()
+
+    src, conf = generate(args.output_dir, args.name, args.lang,
+                         args.functions, args.templates, args.instantiations,
+                         args.lambdas, args.select)
+    print(src)
+    print(conf)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
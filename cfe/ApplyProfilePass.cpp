@@ -0,0 +1,112 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "CFEContext.h"
+#include "Passes.h"
+#include "PhaseTimer.h"
+
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/Pass.h>
+#include <llvm/Transforms/IPO/PassManagerBuilder.h>
+
+using namespace llvm;
+
+// Uses the output of an earlier instrumented run as a lightweight profile.
+// Functions that were hot in it are made more likely to be inlined and those
+// that were cold are optimized for size. The hot and cold functions are put
+// in separate sections so the hot code is packed together. This has to be
+// done before the inliner runs. Functions that are not optimized are left
+// alone since they cannot be optimized for size
+static bool applyProfile(Module& mod) {
+  PhaseTimer timer(CFEContext::Phase::ApplyProfile);
+  CFEContext& cfeContext = CFEContext::getSingleton();
+  if(not cfeContext.hasProfile())
+    return false;
+
+  bool changed = false;
+  for(Function& f : mod.functions()) {
+    if(f.isDeclaration() or f.hasFnAttribute(Attribute::OptimizeNone))
+      continue;
+
+    uint64_t count = 0;
+    switch(cfeContext.getHint(f, count)) {
+    case CFEContext::Hint::Hot:
+      if(not f.hasFnAttribute(Attribute::NoInline))
+        f.addFnAttr(Attribute::InlineHint);
+      f.setSectionPrefix(".hot");
+      break;
+    case CFEContext::Hint::Cold:
+      f.addFnAttr(Attribute::Cold);
+      f.addFnAttr(Attribute::MinSize);
+      f.addFnAttr(Attribute::OptimizeForSize);
+      f.setSectionPrefix(".unlikely");
+      break;
+    default:
+      continue;
+    }
+
+    // The counts are only a hint. They are not scaled to any sampling rate
+    if(cfeContext.useEntryCounts())
+      f.setEntryCount(count);
+    changed = true;
+  }
+
+  return changed;
+}
+
+class ApplyProfilePass : public ModulePass {
+public:
+  static char ID;
+
+public:
+  ApplyProfilePass() : ModulePass(ID) {
+    ;
+  }
+
+  virtual StringRef getPassName() const override {
+    return "hwcinstr-profile";
+  }
+
+  virtual void getAnalysisUsage(AnalysisUsage& AU) const override {
+    AU.setPreservesCFG();
+  }
+
+  virtual bool runOnModule(Module& mod) override {
+    return applyProfile(mod);
+  }
+};
+
+char ApplyProfilePass::ID = 0;
+
+namespace hwc {
+
+PreservedAnalyses ApplyProfile::run(Module& mod, ModuleAnalysisManager&) {
+  if(not applyProfile(mod))
+    return PreservedAnalyses::all();
+
+  PreservedAnalyses pa;
+  pa.preserveSet<CFGAnalyses>();
+  return pa;
+}
+
+} // namespace hwc
+
+// Nothing is optimized at -O0, so the pass is not added there
+static void registerPass(const PassManagerBuilder&,
+                         legacy::PassManagerBase& pm) {
+  pm.add(new ApplyProfilePass());
+}
+
+static RegisterStandardPasses
+    registerEarly(PassManagerBuilder::EP_ModuleOptimizerEarly, registerPass);
@@ -13,10 +13,15 @@
 // limitations under the License.
 
 #include "CFEContext.h"
+#include "common/Formatting.h"
+#include "common/Profile.h"
 
 #include <openssl/md5.h>
 
+#include <algorithm>
 #include <cstdio>
+#include <cstdlib>
+#include <fstream>
 #include <sstream>
 
 using llvm::cast;
@@ -34,7 +39,10 @@ CFEContext& CFEContext::getSingleton() {
   return *gCFEContext;
 }
 
-CFEContext::CFEContext() : papiContext(true), conf(papiContext) {
+CFEContext::CFEContext()
+    : backend(CounterBackend::create()), mode(Mode::Wrapper), conf(*backend),
+      minCost(0), countCheap(false), profileMax(0), profileSamples(-1),
+      hotShare(0.05), coldShare(0.0001), entryCounts(false), phaseTimes() {
   ;
 }
 
@@ -60,15 +68,15 @@ static IDType constructID(std::string s) {
 static RegionID constructRegionID(const std::string& file,
                                   unsigned startLine,
                                   unsigned endLine,
-                                  const std::vector<CounterID>& counters) {
+                                  const std::vector<std::string>& counters) {
   // This is a ridiculous way of getting a hash
 
-  // Concatenate everything including the counter ids. They are added to
+  // Concatenate everything including the counter names. They are added to
   // minimize the small chances of a collision
   std::stringstream ss;
   ss << file << ":" << startLine << ":" << endLine;
-  for(CounterID id : counters)
-    ss << ":" << id;
+  for(const std::string& counter : counters)
+    ss << ":" << counter;
 
   return constructID<RegionID>(ss.str());
 }
@@ -80,7 +88,7 @@ static FunctionID constructFunctionID(const std::string& mangled) {
 void CFEContext::addFunction(const std::string& mangled,
                              const std::string& srcName,
                              const std::string& qualName,
-                             const std::vector<CounterID>& counters) {
+                             const std::vector<std::string>& counters) {
   funcs.emplace(std::pair<std::string, hwc::FEFuncMeta>(
       mangled,
       {constructFunctionID(mangled),
@@ -89,10 +97,25 @@ void CFEContext::addFunction(const std::string& mangled,
        (srcName != qualName) ? qualName : ""}));
 }
 
+// The call sites of a function are measured separately from the function
+// itself in case it is also instrumented elsewhere, so they get a different
+// ID and name
+void CFEContext::addCallee(const std::string& mangled,
+                           const std::string& srcName,
+                           const std::string& qualName,
+                           const std::vector<std::string>& counters) {
+  callees.emplace(std::pair<std::string, hwc::FEFuncMeta>(
+      mangled,
+      {constructFunctionID("calls:" + mangled),
+       counters,
+       srcName + "@calls",
+       (srcName != qualName) ? qualName + "@calls" : ""}));
+}
+
 void CFEContext::addRegion(const std::string& file,
                            unsigned startLine,
                            unsigned endLine,
-                           const std::vector<CounterID>& counters) {
+                           const std::vector<std::string>& counters) {
   regions.emplace_back(constructRegionID(file, startLine, endLine, counters),
                        counters,
                        file,
@@ -100,20 +123,85 @@ void CFEContext::addRegion(const std::string& file,
                        endLine);
 }
 
-bool CFEContext::shouldInstrument(llvm::Function& f) const {
-  return funcs.find(f.getName()) != funcs.end();
+CFEContext::Decision CFEContext::decide(llvm::Function& f,
+                                        const hwc::FEFuncMeta& meta) const {
+  Decision decision = {Action::Instrument, {0, 0, 0}, "selected"};
+  if(minCost or instrReport.length())
+    decision.cost = hwc::estimateCost(f);
+
+  unsigned cost = decision.cost.getTotal();
+  if(conf.isPinned(meta.srcName)) {
+    decision.reason = "pinned";
+  } else if(minCost and cost >= minCost) {
+    decision.reason = "cost " + std::to_string(cost) + " is at least "
+                      + std::to_string(minCost);
+  } else if(minCost) {
+    decision.action = countCheap ? Action::CountOnly : Action::Skip;
+    decision.reason = "cost " + std::to_string(cost) + " is below "
+                      + std::to_string(minCost);
+  }
+
+  return decision;
+}
+
+bool CFEContext::shouldInstrument(llvm::Function& f) {
+  // The names of all the matching functions in the AST are recorded, but
+  // only those that were actually defined in this module can be instrumented
+  std::string name = f.getName().str();
+  auto it = funcs.find(name);
+  if(not f.size() or it == funcs.end())
+    return false;
+
+  auto d = decisions.find(name);
+  if(d != decisions.end())
+    return d->second.action != Action::Skip;
+
+  Decision decision = decide(f, it->second);
+  if(decision.action == Action::CountOnly) {
+    hwc::FEFuncMeta meta(
+        it->second.id, {}, it->second.srcName, it->second.qualName);
+    funcs.erase(it);
+    funcs.emplace(name, meta);
+  }
+  decisions.emplace(name, decision);
+
+  return decision.action != Action::Skip;
 }
 
 const hwc::FEFuncMeta& CFEContext::getFuncMeta(llvm::Function& f) const {
   return funcs.at(f.getName());
 }
 
+// Functions that are only declared in the IR but never appeared in the AST,
+// such as the library functions that the compiler emits calls to on its own,
+// are matched by their symbol names
+const hwc::FEFuncMeta* CFEContext::getCallee(llvm::Function& f) {
+  if(not f.isDeclaration() or f.isIntrinsic())
+    return nullptr;
+
+  std::string name = f.getName().str();
+  auto it = callees.find(name);
+  if(it == callees.end() and conf.hasCall(name)) {
+    addCallee(name, name, name, conf.getCallCounters(name));
+    it = callees.find(name);
+  }
+  return it != callees.end() ? &it->second : nullptr;
+}
+
 CFEContext::region_range CFEContext::getRegions() const {
   return region_range(regions.begin(), regions.end());
 }
 
-const PAPIContext& CFEContext::getPAPIContext() const {
-  return papiContext;
+const CounterBackend& CFEContext::getBackend() const {
+  return *backend;
+}
+
+void CFEContext::setMode(Mode mode) {
+  this->mode = mode;
+}
+
+CFEContext::Mode CFEContext::getMode() const {
+  return mode;
 }
 
 Conf& CFEContext::getConf() {
@@ -123,3 +211,155 @@ Conf& CFEContext::getConf() {
 const Conf& CFEContext::getConf() const {
   return conf;
 }
+
+void CFEContext::setInput(const std::string& input) {
+  this->input = input;
+}
+
+// The report is written when the compiler exits because the passes may run
+// long after the plugin has finished
+void CFEContext::setTimeReport(const std::string& file) {
+  if(timeReport.empty())
+    std::atexit([]() { CFEContext::getSingleton().writeTimeReport(); });
+  timeReport = file;
+}
+
+void CFEContext::setMinCost(unsigned minCost) {
+  this->minCost = minCost;
+}
+
+void CFEContext::setCountCheap(bool countCheap) {
+  this->countCheap = countCheap;
+}
+
+void CFEContext::setInstrReport(const std::string& file) {
+  if(instrReport.empty())
+    std::atexit([]() { CFEContext::getSingleton().writeInstrReport(); });
+  instrReport = file;
+}
+
+void CFEContext::addPhaseTime(Phase phase, uint64_t ns) {
+  phaseTimes[static_cast<size_t>(phase)] += ns;
+}
+
+// The report is appended as a single line of JSON so that the same file can
+// be used for every file in a build
+void CFEContext::writeTimeReport() const {
+  static const char* names[] = {"conf",
+                                "consumer",
+                                "generate_wrappers",
+                                "generate_symbols",
+                                "mark_functions",
+                                "instrument_functions",
+                                "instrument_calls",
+                                "apply_profile"};
+
+  std::stringstream ss;
+  ss << "{\"input\":" << quoteJSON(input);
+  for(size_t i = 0; i < phaseTimes.size(); i++)
+    ss << ",\"" << names[i] << "\":" << phaseTimes[i];
+  ss << "}\n";
+
+  std::ofstream of(timeReport.c_str(), std::ios::app);
+  of << ss.str();
+}
+
+// Like the time report, this is appended as a single line of JSON for each
+// file. Only the functions that were selected and defined in the file are
+// included
+void CFEContext::writeInstrReport() const {
+  static const char* actions[] = {"instrumented", "count-only", "skipped"};
+
+  std::stringstream ss;
+  ss << "{\"input\":" << quoteJSON(input) << ",\"functions\":[";
+  bool first = true;
+  for(const auto& i : decisions) {
+    const hwc::FEFuncMeta& meta = funcs.at(i.first);
+    const Decision& decision = i.second;
+    ss << (first ? "" : ",") << "{\"mangled\":" << quoteJSON(i.first)
+       << ",\"name\":"
+       << quoteJSON(meta.qualName.length() ? meta.qualName : meta.srcName)
+       << ",\"action\":\"" << actions[static_cast<int>(decision.action)]
+       << "\",\"reason\":" << quoteJSON(decision.reason)
+       << ",\"cost\":" << decision.cost.getTotal()
+       << ",\"instructions\":" << decision.cost.instructions
+       << ",\"loops\":" << decision.cost.loops
+       << ",\"calls\":" << decision.cost.calls << "}";
+    first = false;
+  }
+  ss << "]}\n";
+
+  std::ofstream of(instrReport.c_str(), std::ios::app);
+  of << ss.str();
+}
+
+bool CFEContext::setProfile(const std::string& file) {
+  profile.reset(new Profile(file));
+  if(not profile->read(1)) {
+    profile.reset();
+    return false;
+  }
+
+  profileMax = 0;
+  profileSamples = -1;
+  for(const auto& i : profile->getEntries())
+    profileMax = std::max<double>(profileMax, i.second.time);
+  if(profileMax == 0)
+    profileSamples = profile->getCounterID("samples");
+  for(const auto& i : profile->getEntries())
+    for(const auto& counter : i.second.counters)
+      if(static_cast<int>(counter.first) == profileSamples)
+        profileMax = std::max<double>(profileMax, counter.second);
+
+  return true;
+}
+
+void CFEContext::setHotShare(double share) {
+  hotShare = share;
+}
+
+void CFEContext::setColdShare(double share) {
+  coldShare = share;
+}
+
+void CFEContext::setEntryCounts(bool entryCounts) {
+  this->entryCounts = entryCounts;
+}
+
+bool CFEContext::hasProfile() const {
+  return profile and profileMax > 0;
+}
+
+bool CFEContext::useEntryCounts() const {
+  return entryCounts;
+}
+
+// A function that is called more often than this is never marked cold
+// however little time it takes, because the optimizer would then treat its
+// call sites as unlikely to be reached
+static constexpr long long MaxColdCalls = 1000;
+
+// The IDs of the functions do not depend on whether they were instrumented
+// or on the order of the files, so any function that was measured in the
+// earlier run is found even if the code has changed since. The time is
+// inclusive, so callers are hot because of what they call unless the
+// profile is from a sampling run
+CFEContext::Hint CFEContext::getHint(llvm::Function& f,
+                                     uint64_t& count) const {
+  FunctionID id = constructFunctionID(f.getName().str());
+  const Entry* entry = profile->getEntry({Kind::Function, id});
+  if(not entry)
+    return Hint::None;
+
+  double val = entry->time;
+  for(const auto& counter : entry->counters)
+    if(static_cast<int>(counter.first) == profileSamples)
+      val = counter.second;
+
+  count = entry->occurs;
+  if(val >= hotShare * profileMax)
+    return Hint::Hot;
+  else if(val <= coldShare * profileMax and entry->occurs <= MaxColdCalls)
+    return Hint::Cold;
+  return Hint::None;
+}
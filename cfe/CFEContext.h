@@ -15,29 +15,121 @@
 #ifndef HWC_CFE_CONTEXT_H
 #define HWC_CFE_CONTEXT_H
 
+#include "EstimateCost.h"
 #include "common/Conf.h"
-#include "common/PAPIContext.h"
+#include "common/CounterBackend.h"
 #include "common/Types.h"
 
 #include <clang/AST/DeclCXX.h>
 
 #include <llvm/IR/Function.h>
 
+#include <array>
+#include <memory>
+
+class Profile;
+
 // Class that contains all the data that will be collected by the Clang plugin
 // and used by the LLVM pass
 class CFEContext {
+public:
+  // How the calls to the runtime are added to the instrumented functions
+  enum class Mode {
+    // Replace the function with a wrapper before any optimizations are run
+    Wrapper,
+
+    // Add the calls to the body of the function after all the optimizations
+    // have been run
+    Late,
+
+    // Like Late except that sleds which do nothing until they are patched by
+    // the runtime are added instead of the calls
+    Sled,
+  };
+
+  // What is done with a function that was selected in the config
+  enum class Action {
+    Instrument,
+
+    // The function is instrumented without any counters
+    CountOnly,
+
+    // The function is not instrumented at all
+    Skip,
+  };
+
+  // What the profile of an earlier run says about a function
+  enum class Hint {
+    None,
+    Hot,
+    Cold,
+  };
+
+  // The phases of the plugin whose compile-time cost is measured
+  enum class Phase {
+    Conf,
+    Consumer,
+    GenerateWrappers,
+    GenerateSymbols,
+    MarkFunctions,
+    InstrumentFunctions,
+    InstrumentCalls,
+    ApplyProfile,
+    Last,
+  };
+
 protected:
-  const PAPIContext papiContext;
+  std::unique_ptr<CounterBackend> backend;
+  Mode mode;
   Conf conf;
   std::map<std::string, hwc::FEFuncMeta> funcs;
   std::vector<hwc::FERegionMeta> regions;
 
+  // The functions in other libraries whose calls are instrumented at the
+  // call sites, keyed by their mangled names. Each of them is measured as
+  // if it were a separate function
+  std::map<std::string, hwc::FEFuncMeta> callees;
+
+  // The decision is made for each function the first time that any of the
+  // passes asks about it, and it is never changed afterwards. Functions
+  // whose estimated cost is below minCost are skipped or only counted
+  // unless they are pinned in the config. A minCost of 0 instruments every
+  // function that was selected
+  struct Decision {
+    Action action;
+    hwc::Cost cost;
+    std::string reason;
+  };
+  std::map<std::string, Decision> decisions;
+  unsigned minCost;
+  bool countCheap;
+  std::string instrReport;
+
+  // The output of an earlier instrumented run. A function in it is hot if
+  // its time is at least hotShare of the largest time of any function and
+  // cold if it is at most coldShare of it and it was not called often. If
+  // nothing was timed because it was a sampling run, the samples are used
+  // instead
+  std::unique_ptr<Profile> profile;
+  double profileMax;
+  int profileSamples;
+  double hotShare;
+  double coldShare;
+  bool entryCounts;
+
+  // The time in nanoseconds spent in each phase. This is only written out if
+  // a file for it has been given
+  std::array<uint64_t, static_cast<size_t>(Phase::Last)> phaseTimes;
+  std::string timeReport;
+  std::string input;
+
 public:
   using region_iterator = decltype(regions)::const_iterator;
   using region_range = llvm::iterator_range<region_iterator>;
 
 protected:
   const clang::FunctionDecl* getDecl(llvm::Function& f) const;
+  Decision decide(llvm::Function& f, const hwc::FEFuncMeta& meta) const;
 
 public:
   CFEContext();
@@ -47,19 +139,50 @@ public:
   void addFunction(const std::string& mangled,
                    const std::string& srcName,
                    const std::string& qualName,
-                   const std::vector<CounterID>& counters);
+                   const std::vector<std::string>& counters);
+  void addCallee(const std::string& mangled,
+                 const std::string& srcName,
+                 const std::string& qualName,
+                 const std::vector<std::string>& counters);
   void addRegion(const std::string& file,
                  unsigned start,
                  unsigned end,
-                 const std::vector<CounterID>& counters);
+                 const std::vector<std::string>& counters);
   llvm::LLVMContext& getLLVMContext();
 
+  void setMode(Mode mode);
+  Mode getMode() const;
+
+  void setInput(const std::string& input);
+  void setTimeReport(const std::string& file);
+  void addPhaseTime(Phase phase, uint64_t ns);
+  void writeTimeReport() const;
+
+  void setMinCost(unsigned minCost);
+  void setCountCheap(bool countCheap);
+  void setInstrReport(const std::string& file);
+  void writeInstrReport() const;
+
+  // Returns false if the profile could not be read
+  bool setProfile(const std::string& file);
+  void setHotShare(double share);
+  void setColdShare(double share);
+  void setEntryCounts(bool entryCounts);
+  bool hasProfile() const;
+  bool useEntryCounts() const;
+
+  // The number of calls to the function in the profile is returned in count
+  Hint getHint(llvm::Function& f, uint64_t& count) const;
+
   Conf& getConf();
   const Conf& getConf() const;
-  const PAPIContext& getPAPIContext() const;
-  bool shouldInstrument(llvm::Function& f) const;
+  const CounterBackend& getBackend() const;
+  bool shouldInstrument(llvm::Function& f);
   const hwc::FEFuncMeta& getFuncMeta(llvm::Function& f) const;
 
+  // Returns nullptr if the calls to the function should not be instrumented
+  const hwc::FEFuncMeta* getCallee(llvm::Function& f);
+
   region_range getRegions() const;
 
 public:
@@ -13,13 +13,15 @@
 // limitations under the License.
 
 #include "CFEContext.h"
+#include "PhaseTimer.h"
 #include "../common/Conf.h"
 
 #include <clang/AST/ASTConsumer.h>
 #include <clang/AST/ASTContext.h>
 #include <clang/AST/Attr.h>
-#include <clang/CodeGen/ModuleBuilder.h>
+#include <clang/AST/Mangle.h>
 #include <clang/AST/RecursiveASTVisitor.h>
+#include <clang/Basic/ABI.h>
 #include <clang/Frontend/CompilerInstance.h>
 #include <clang/Frontend/FrontendAction.h>
 #include <clang/Frontend/FrontendPluginRegistry.h>
@@ -28,100 +30,121 @@
 #include <clang/Sema/Sema.h>
 #include <clang/Sema/SemaDiagnostic.h>
 
-#include <llvm/IR/Module.h>
+#include <llvm/Support/raw_ostream.h>
 
 using namespace clang;
 
-// The consumer is a wrapper around a code generator which generates an
-// LLVM module. The functions in that module are then associated with the
-// Clang Decl's. The Decl's can't be kept around until the final LLVM module
-// is generated and instrumented because the ASTContext object containing the
-// Decl's will have been deleted by then. So everything has to be associated
-// after the translation unit has been handled by the code generator
-class Consumer : public ASTConsumer {
+// Walks the AST and records the mangled names of the functions that have been
+// selected for instrumentation in the config file. The LLVM pass looks up the
+// functions by their mangled names. The Decl's can't be kept around until the
+// final LLVM module is generated and instrumented because the ASTContext
+// object containing the Decl's will have been deleted by then. So the mangled
+// names are computed here using the same mangler that the code generator uses
+class FunctionFinder : public RecursiveASTVisitor<FunctionFinder> {
 protected:
-  llvm::LLVMContext llvmContext;
-  CodeGenerator& cg;
-  std::unique_ptr<CodeGenerator> pcg;
+  CFEContext& cfeContext;
+  const Conf& conf;
+  std::unique_ptr<MangleContext> mangler;
 
-public:
-  explicit Consumer(CompilerInstance& compiler)
-      : cg(*CreateLLVMCodeGen(compiler.getDiagnostics(),
-                              "",
-                              compiler.getHeaderSearchOpts(),
-                              compiler.getPreprocessorOpts(),
-                              compiler.getCodeGenOpts(),
-                              llvmContext,
-                              nullptr)) {
-    pcg.reset(&cg);
+protected:
+  std::string mangle(const FunctionDecl* decl) {
+    std::string buf;
+    llvm::raw_string_ostream os(buf);
+    if(mangler->shouldMangleDeclName(decl))
+      mangler->mangleName(decl, os);
+    else
+      os << decl->getName();
+    return os.str();
   }
 
-  virtual void HandleTranslationUnit(ASTContext& astContext) override {
-    cg.HandleTranslationUnit(astContext);
-
-    CFEContext& cfeContext = CFEContext::getSingleton();
-    const Conf& conf = cfeContext.getConf();
-
-    // If there was an error during code generation the llvm::Module will be
-    // null
-    if(llvm::Module* mod = cg.GetModule()) {
-      for(llvm::Function& f : *mod) {
-        const std::string& mangled = f.getName();
-        if(auto* decl
-           = cast_or_null<FunctionDecl>(cg.GetDeclForMangledName(mangled))) {
-          const std::string& srcName = decl->getNameAsString();
-          const std::string& qualName = decl->getQualifiedNameAsString();
-          if(f.size() and conf.has(srcName))
-            cfeContext.addFunction(
-                mangled, srcName, qualName, conf.getCounters(srcName));
-        }
-      }
-    }
+  std::string mangle(const CXXConstructorDecl* decl, CXXCtorType type) {
+    std::string buf;
+    llvm::raw_string_ostream os(buf);
+    mangler->mangleCXXCtor(decl, type, os);
+    return os.str();
   }
 
-  virtual void Initialize(ASTContext& astContext) override {
-    return cg.Initialize(astContext);
+  std::string mangle(const CXXDestructorDecl* decl, CXXDtorType type) {
+    std::string buf;
+    llvm::raw_string_ostream os(buf);
+    mangler->mangleCXXDtor(decl, type, os);
+    return os.str();
   }
 
-  virtual bool HandleTopLevelDecl(DeclGroupRef g) override {
-    return cg.HandleTopLevelDecl(g);
+  // Constructors and destructors have several variants each of which gets a
+  // different mangled name. Any of them could end up in the LLVM module
+  // depending on the target and the options, so all of them are recorded.
+  // The ones that were not code-generated will simply never be looked up
+  std::vector<std::string> getMangledNames(const FunctionDecl* decl) {
+    if(const auto* ctor = dyn_cast<CXXConstructorDecl>(decl))
+      return {mangle(ctor, Ctor_Complete), mangle(ctor, Ctor_Base)};
+    else if(const auto* dtor = dyn_cast<CXXDestructorDecl>(decl))
+      return {mangle(dtor, Dtor_Deleting),
+              mangle(dtor, Dtor_Complete),
+              mangle(dtor, Dtor_Base)};
+    return {mangle(decl)};
   }
 
-  virtual void HandleInlineFunctionDefinition(FunctionDecl* f) override {
-    return cg.HandleInlineFunctionDefinition(f);
+public:
+  FunctionFinder(ASTContext& astContext)
+      : cfeContext(CFEContext::getSingleton()), conf(cfeContext.getConf()),
+        mangler(astContext.createMangleContext()) {
+    ;
   }
 
-  virtual void HandleInterestingDecl(DeclGroupRef g) override {
-    return cg.HandleInterestingDecl(g);
+  bool shouldVisitTemplateInstantiations() const {
+    return true;
   }
 
-  virtual void HandleTagDeclDefinition(TagDecl* tag) override {
-    return cg.HandleTagDeclDefinition(tag);
+  // The call operators of lambdas are only reached through their implicit
+  // closure classes
+  bool shouldVisitImplicitCode() const {
+    return true;
   }
 
-  virtual void HandleTagDeclRequiredDefinition(const TagDecl* tag) override {
-    return cg.HandleTagDeclRequiredDefinition(tag);
-  }
+  bool VisitFunctionDecl(FunctionDecl* decl) {
+    // The calls to functions in libraries that cannot be recompiled are
+    // instrumented instead. They only need to have been declared
+    const std::string& srcName = decl->getNameAsString();
+    if(conf.hasCall(srcName) and not decl->isDependentContext()
+       and not isa<CXXDeductionGuideDecl>(decl))
+      for(const std::string& mangled : getMangledNames(decl))
+        cfeContext.addCallee(mangled,
+                             srcName,
+                             decl->getQualifiedNameAsString(),
+                             conf.getCallCounters(srcName));
 
-  virtual void
-  HandleCXXImplicitFunctionInstantiation(FunctionDecl* f) override {
-    return cg.HandleCXXImplicitFunctionInstantiation(f);
-  }
+    // Only definitions will end up with a body in the LLVM module. The
+    // templated patterns themselves are never code-generated, only their
+    // instantiations are. Deduction guides never have any code
+    if(not decl->doesThisDeclarationHaveABody() or decl->isDependentContext()
+       or isa<CXXDeductionGuideDecl>(decl))
+      return true;
 
-  virtual void CompleteTentativeDefinition(VarDecl* var) override {
-    return cg.CompleteTentativeDefinition(var);
-  }
+    if(not conf.has(srcName))
+      return true;
 
-  virtual void AssignInheritanceModel(CXXRecordDecl* record) override {
-    return cg.AssignInheritanceModel(record);
+    const std::string& qualName = decl->getQualifiedNameAsString();
+    for(const std::string& mangled : getMangledNames(decl))
+      cfeContext.addFunction(
+          mangled, srcName, qualName, conf.getCounters(srcName));
+
+    return true;
   }
+};
 
-  virtual void HandleCXXStaticMemberVarInstantiation(VarDecl* var) override {
-    return cg.HandleCXXStaticMemberVarInstantiation(var);
+class Consumer : public ASTConsumer {
+public:
+  explicit Consumer(CompilerInstance& compiler) {
+    const FrontendOptions& opts = compiler.getFrontendOpts();
+    if(opts.Inputs.size() and opts.Inputs[0].isFile())
+      CFEContext::getSingleton().setInput(opts.Inputs[0].getFile());
   }
 
-  virtual void HandleVTable(CXXRecordDecl* record) override {
-    return cg.HandleVTable(record);
+  virtual void HandleTranslationUnit(ASTContext& astContext) override {
+    PhaseTimer timer(CFEContext::Phase::Consumer);
+    FunctionFinder finder(astContext);
+    finder.TraverseDecl(astContext.getTranslationUnitDecl());
   }
 };
 
@@ -152,6 +175,7 @@ protected:
           return false;
         }
 
+        PhaseTimer timer(CFEContext::Phase::Conf);
         Conf& conf = cfeContext.getConf();
         if(not conf.parse(file)) {
           unsigned id
@@ -161,6 +185,78 @@ protected:
           return false;
         }
         i += 1;
+      } else if(args[i] == "-late") {
+        cfeContext.setMode(CFEContext::Mode::Late);
+      } else if(args[i] == "-sleds") {
+        cfeContext.setMode(CFEContext::Mode::Sled);
+      } else if(args[i] == "-time-report") {
+        if((i + 1) >= args.size()) {
+          unsigned id = diag.getCustomDiagID(
+              DiagnosticsEngine::Error,
+              "hwcinstr: Required argument for -time-report");
+          diag.Report(id);
+          return false;
+        }
+        cfeContext.setTimeReport(args[i + 1]);
+        i += 1;
+      } else if(args[i] == "-min-cost") {
+        unsigned minCost = 0;
+        if((i + 1) >= args.size()
+           or llvm::StringRef(args[i + 1]).getAsInteger(10, minCost)) {
+          unsigned id = diag.getCustomDiagID(
+              DiagnosticsEngine::Error,
+              "hwcinstr: Required integer argument for -min-cost");
+          diag.Report(id);
+          return false;
+        }
+        cfeContext.setMinCost(minCost);
+        i += 1;
+      } else if(args[i] == "-count-cheap") {
+        cfeContext.setCountCheap(true);
+      } else if(args[i] == "-instr-report") {
+        if((i + 1) >= args.size()) {
+          unsigned id = diag.getCustomDiagID(
+              DiagnosticsEngine::Error,
+              "hwcinstr: Required argument for -instr-report");
+          diag.Report(id);
+          return false;
+        }
+        cfeContext.setInstrReport(args[i + 1]);
+        i += 1;
+      } else if(args[i] == "-profile") {
+        if((i + 1) >= args.size()) {
+          unsigned id = diag.getCustomDiagID(
+              DiagnosticsEngine::Error,
+              "hwcinstr: Required argument for -profile");
+          diag.Report(id);
+          return false;
+        }
+
+        PhaseTimer timer(CFEContext::Phase::ApplyProfile);
+        if(not cfeContext.setProfile(args[i + 1])) {
+          unsigned id = diag.getCustomDiagID(
+              DiagnosticsEngine::Error, "hwcinstr: Could not read profile");
+          diag.Report(id);
+          return false;
+        }
+        i += 1;
+      } else if(args[i] == "-hot" or args[i] == "-cold") {
+        double pct = 0;
+        if((i + 1) >= args.size()
+           or llvm::StringRef(args[i + 1]).getAsDouble(pct)) {
+          unsigned id = diag.getCustomDiagID(
+              DiagnosticsEngine::Error,
+              "hwcinstr: Required percentage for '%0'");
+          diag.Report(id) << args[i];
+          return false;
+        }
+        if(args[i] == "-hot")
+          cfeContext.setHotShare(pct / 100);
+        else
+          cfeContext.setColdShare(pct / 100);
+        i += 1;
+      } else if(args[i] == "-entry-counts") {
+        cfeContext.setEntryCounts(true);
       } else if(args[i] == "-help") {
         PrintHelp(llvm::errs());
         return false;
@@ -176,8 +272,23 @@ protected:
   }
   void PrintHelp(llvm::raw_ostream& os) {
     os << "Should print something helpful here\n";
+    os << "  -conf <file>  The config file\n";
+    os << "  -late         Instrument the functions after optimization\n";
+    os << "  -sleds        Like -late but add sleds patched by the runtime\n";
+    os << "  -time-report <file>\n"
+       << "                Append the time spent in each phase to the file\n";
+    os << "  -min-cost <n> Do not instrument functions whose estimated cost\n"
+       << "                is below n unless they are pinned in the config\n";
+    os << "  -count-cheap  Instrument them without counters instead\n";
+    os << "  -instr-report <file>\n"
+       << "                Append what was instrumented and why to the file\n";
+    os << "  -profile <file>\n"
+       << "                Mark the hot and cold functions in an earlier run\n";
+    os << "  -hot <pct>    Hot if at least this share of the time [5]\n";
+    os << "  -cold <pct>   Cold if at most this share of the time [0.01]\n";
+    os << "  -entry-counts Set the entry counts of the functions too\n";
   }
 };
 
 static FrontendPluginRegistry::Add<HWCInstrAction>
-    X("hwcinstr", "Instrument functions with PAPI");
+    X("hwcinstr", "Instrument functions with hardware counters");
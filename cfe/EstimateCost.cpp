@@ -0,0 +1,50 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "EstimateCost.h"
+
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/IntrinsicInst.h>
+
+using namespace llvm;
+
+namespace hwc {
+
+// The estimate is made before the optimizations have run, so the allocas and
+// the debug intrinsics which will mostly disappear are not counted. Calls to
+// intrinsics are counted as ordinary instructions
+Cost estimateCost(Function& f) {
+  Cost cost = {0, 0, 0};
+  if(f.isDeclaration())
+    return cost;
+
+  for(Instruction& inst : instructions(f)) {
+    if(isa<AllocaInst>(inst) or isa<DbgInfoIntrinsic>(inst))
+      continue;
+    if(isa<CallInst>(inst) or isa<InvokeInst>(inst))
+      if(not isa<IntrinsicInst>(inst))
+        cost.calls += 1;
+    cost.instructions += 1;
+  }
+
+  DominatorTree dt(f);
+  LoopInfo li(dt);
+  cost.loops = li.getLoopsInPreorder().size();
+
+  return cost;
+}
+
+} // namespace hwc
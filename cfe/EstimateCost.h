@@ -0,0 +1,44 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef HWC_ESTIMATE_COST_H
+#define HWC_ESTIMATE_COST_H
+
+#include <llvm/IR/Function.h>
+
+namespace hwc {
+
+// A rough, static estimate of how much work a single call to a function does.
+// This is only used to tell apart functions that are so small that the
+// instrumentation would cost more than the function itself
+struct Cost {
+  // A loop could run for any number of iterations and a call could do any
+  // amount of work, so they are weighted well above ordinary instructions
+  static constexpr unsigned LoopWeight = 1000;
+  static constexpr unsigned CallWeight = 25;
+
+  unsigned instructions;
+  unsigned loops;
+  unsigned calls;
+
+  unsigned getTotal() const {
+    return instructions + loops * LoopWeight + calls * CallWeight;
+  }
+};
+
+Cost estimateCost(llvm::Function& f);
+
+} // namespace hwc
+
+#endif // HWC_ESTIMATE_COST_H
@@ -15,19 +15,24 @@
 #include "CFEContext.h"
 #include "ConvertTypes.h"
 #include "ConvertConstants.h"
+#include "Passes.h"
+#include "PhaseTimer.h"
 #include "common/SymbolNames.h"
 
+#include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/LegacyPassManager.h>
 #include <llvm/Pass.h>
 #include <llvm/Transforms/IPO/PassManagerBuilder.h>
 #include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/Utils/ModuleUtils.h>
 
 using namespace llvm;
 
 // Generates global variables containing any data that the runtime needs to
 // do its work. Required things are the counters that must be recorded for
 // each function and region. Optional things are source-level names that make
-// the output useful
+// the output useful. The records are placed in dedicated sections so that any
+// number of instrumented modules can be linked together
 class GenerateSymbolsPass : public ModulePass {
 public:
   static char ID;
@@ -52,13 +57,13 @@ public:
   StructType* createFuncMetaTy(Module& mod) {
     // struct FuncMeta {
     //   FunctionID id;
-    //   const CounterID* counters;
+    //   const char* const* counters;
     //   unsigned numCounters;
     //   const char* srcName;
     //   const char* qualName;
     // };
     Type* types[] = {hwc::getType<FunctionID>(mod),
-                     hwc::getType<CounterID*>(mod),
+                     hwc::getType<const char**>(mod),
                      hwc::getType<unsigned>(mod),
                      hwc::getType<const char*>(mod),
                      hwc::getType<const char*>(mod)};
@@ -68,14 +73,14 @@ public:
   StructType* createRegionMetaTy(Module& mod) {
     // struct RegionMeta {
     //   RegionID id;
-    //   const CounterID* counters;
+    //   const char* const* counters;
     //   unsigned numCounters;
     //   const char* file;
     //   unsigned startLine;
     //   unsigned endLine;
     // };
     Type* types[] = {hwc::getType<FunctionID>(mod),
-                     hwc::getType<CounterID*>(mod),
+                     hwc::getType<const char**>(mod),
                      hwc::getType<unsigned>(mod),
                      hwc::getType<const char*>(mod),
                      hwc::getType<unsigned>(mod),
@@ -83,6 +88,20 @@ public:
     return StructType::create(types, "hwc::RegionMeta");
   }
 
+  StructType* createSledTy(Module& mod) {
+    // struct Sled {
+    //   uintptr_t address;
+    //   FunctionID id;
+    //   uint64_t kind;
+    //   void* trampoline;
+    // };
+    Type* types[] = {hwc::getType<uintptr_t>(mod),
+                     hwc::getType<FunctionID>(mod),
+                     hwc::getType<uint64_t>(mod),
+                     hwc::getType<char*>(mod)};
+    return StructType::create(types, "hwc::Sled");
+  }
+
   Constant* getConstExpr(GlobalVariable* g) {
     Type* i32 = Type::getInt32Ty(g->getContext());
     Constant* zero = ConstantInt::get(i32, 0);
@@ -91,12 +110,16 @@ public:
         g->getType()->getElementType(), g, indices, true);
   }
 
-  Constant* processFunction(Module& mod,
-                            const hwc::FEFuncMeta& meta,
-                            StructType* metaTy) {
-    auto* gSrc = cast<GlobalVariable>(hwc::getConstant(meta.srcName, mod));
-    auto* gQual = cast<GlobalVariable>(hwc::getConstant(meta.qualName, mod));
-    Constant* cCounters = hwc::getConstant(meta.counters, mod);
+  // The counters are an array of pointers to their names
+  GlobalVariable* createCounters(Module& mod,
+                                 const std::vector<std::string>& counters) {
+    std::vector<Constant*> names;
+    for(const std::string& counter : counters)
+      names.push_back(
+          getConstExpr(cast<GlobalVariable>(hwc::getConstant(counter, mod))));
+    ArrayType* aty
+        = ArrayType::get(hwc::getType<const char*>(mod), counters.size());
+    Constant* cCounters = ConstantArray::get(aty, names);
     auto* gCounters = new GlobalVariable(mod,
                                          cCounters->getType(),
                                          true,
@@ -104,6 +127,15 @@ public:
                                          cCounters,
                                          ".hwc.counters");
     gCounters->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+    return gCounters;
+  }
+
+  Constant* processFunction(Module& mod,
+                            const hwc::FEFuncMeta& meta,
+                            StructType* metaTy) {
+    auto* gSrc = cast<GlobalVariable>(hwc::getConstant(meta.srcName, mod));
+    auto* gQual = cast<GlobalVariable>(hwc::getConstant(meta.qualName, mod));
+    GlobalVariable* gCounters = createCounters(mod, meta.counters);
 
     Constant* fields[] = {hwc::getConstant(meta.id, mod),
                           getConstExpr(gCounters),
@@ -113,32 +145,52 @@ public:
     return ConstantStruct::get(metaTy, fields);
   }
 
-  bool processFunctions(Module& mod) {
-    bool changed = false;
-
-    StructType* metaTy = mod.getTypeByName("hwc::FuncMeta");
-    if(not metaTy)
-      metaTy = createFuncMetaTy(mod);
-
-    std::vector<Constant*> meta;
-    for(Function& f : mod.functions())
-      if(cfeContext.shouldInstrument(f))
-        meta.push_back(processFunction(mod, cfeContext.getFuncMeta(f), metaTy));
-
-    ArrayType* aty = ArrayType::get(metaTy, meta.size());
-    Constant* cMeta = ConstantArray::get(aty, meta);
+  // Each metadata record is a separate global in the metadata section. The
+  // records from all the modules are concatenated by the linker and the
+  // runtime walks them as an array. If the function is in a COMDAT, the
+  // record is put in the same COMDAT so there is only one copy of it at
+  // link time
+  GlobalVariable* addRecord(Module& mod,
+                            Constant* cMeta,
+                            const std::string& section,
+                            Comdat* comdat) {
+    auto* g = new GlobalVariable(mod,
+                                 cMeta->getType(),
+                                 true,
+                                 GlobalValue::PrivateLinkage,
+                                 cMeta,
+                                 ".hwc.meta");
+    g->setSection(section);
+    g->setAlignment(
+        mod.getDataLayout().getABITypeAlignment(cMeta->getType()));
+    g->setComdat(comdat);
+    return g;
+  }
 
-    auto* gMeta = cast<GlobalVariable>(
-        mod.getOrInsertGlobal(hwc::getSymFuncMeta(), cMeta->getType()));
-    gMeta->setConstant(true);
-    gMeta->setLinkage(GlobalValue::ExternalLinkage);
-    gMeta->setInitializer(cMeta);
+  bool processFunctions(Module& mod, StructType* metaTy) {
+    bool changed = false;
 
-    auto* gNumMeta = cast<GlobalVariable>(mod.getOrInsertGlobal(
-        hwc::getSymNumFuncMeta(), hwc::getType<unsigned>(mod)));
-    gNumMeta->setConstant(true);
-    gNumMeta->setLinkage(GlobalValue::ExternalLinkage);
-    gNumMeta->setInitializer(hwc::getConstant<unsigned>(meta.size(), mod));
+    std::vector<GlobalValue*> used;
+    for(Function& f : mod.functions()) {
+      if(cfeContext.shouldInstrument(f)) {
+        Constant* cMeta
+            = processFunction(mod, cfeContext.getFuncMeta(f), metaTy);
+        used.push_back(
+            addRecord(mod, cMeta, hwc::getSecFuncMeta(), f.getComdat()));
+        changed = true;
+      } else if(const hwc::FEFuncMeta* callee = cfeContext.getCallee(f)) {
+        // Every module that calls the function has a record for it. The
+        // runtime ignores the duplicates
+        if(f.use_empty())
+          continue;
+        Constant* cMeta = processFunction(mod, *callee, metaTy);
+        used.push_back(
+            addRecord(mod, cMeta, hwc::getSecFuncMeta(), nullptr));
+        changed = true;
+      }
+    }
+    if(used.size())
+      appendToCompilerUsed(mod, used);
 
     return changed;
   }
@@ -147,14 +199,7 @@ public:
                           const hwc::FERegionMeta& meta,
                           StructType* metaTy) {
     auto* gFile = cast<GlobalVariable>(hwc::getConstant(meta.file, mod));
-    Constant* cCounters = hwc::getConstant(meta.counters, mod);
-    auto* gCounters = new GlobalVariable(mod,
-                                         cCounters->getType(),
-                                         true,
-                                         GlobalValue::PrivateLinkage,
-                                         cCounters,
-                                         "");
-    gCounters->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+    GlobalVariable* gCounters = createCounters(mod, meta.counters);
 
     Constant* fields[] = {hwc::getConstant(meta.id, mod),
                           getConstExpr(gCounters),
@@ -165,40 +210,141 @@ public:
     return ConstantStruct::get(metaTy, fields);
   }
 
-  bool processRegions(Module& mod) {
+  bool processRegions(Module& mod, StructType* metaTy) {
     bool changed = false;
 
-    StructType* metaTy = mod.getTypeByName("hwc::RegionMeta");
-    if(not metaTy)
-      metaTy = createRegionMetaTy(mod);
+    std::vector<GlobalValue*> used;
+    for(const hwc::FERegionMeta& region : cfeContext.getRegions()) {
+      Constant* cMeta = processRegion(mod, region, metaTy);
+      used.push_back(
+          addRecord(mod, cMeta, hwc::getSecRegionMeta(), nullptr));
+      changed = true;
+    }
+    if(used.size())
+      appendToCompilerUsed(mod, used);
+
+    return changed;
+  }
+
+  GlobalVariable* getSectionBound(Module& mod,
+                                  const std::string& name,
+                                  Type* metaTy) {
+    // These will be defined by the linker if the section is not empty. They
+    // are hidden so each executable and shared object sees its own section
+    auto* g = cast<GlobalVariable>(mod.getOrInsertGlobal(name, metaTy));
+    g->setLinkage(GlobalValue::ExternalWeakLinkage);
+    g->setVisibility(GlobalValue::HiddenVisibility);
+    return g;
+  }
+
+  // Position-independent code that is not meant for an executable is
+  // assumed to be going into a shared object
+  bool isSharedObject(Module& mod) {
+    return mod.getPICLevel() != PICLevel::NotPIC
+           and mod.getPIELevel() == PIELevel::Default;
+  }
+
+  // Creates a function that passes the metadata symbol to the given API
+  // function. There is only one copy of it in each shared object
+  Function* createRegistration(Module& mod,
+                               const std::string& fname,
+                               const std::string& api,
+                               GlobalVariable* gMeta) {
+    LLVMContext& llvmContext = mod.getContext();
+    Type* voidTy = Type::getVoidTy(llvmContext);
+    Type* params[] = {gMeta->getType()};
+    FunctionType* apiTy = FunctionType::get(voidTy, params, false);
+    Constant* apiFunc = mod.getOrInsertFunction(api, apiTy);
+
+    FunctionType* fty = FunctionType::get(voidTy, false);
+    Function* f
+        = Function::Create(fty, GlobalValue::LinkOnceODRLinkage, fname, &mod);
+    f->setVisibility(GlobalValue::HiddenVisibility);
+    f->setComdat(mod.getOrInsertComdat(fname));
+    f->addFnAttr(Attribute::AttrKind::NoUnwind);
+
+    IRBuilder<> builder(BasicBlock::Create(llvmContext, "", f));
+    Value* args[] = {gMeta};
+    builder.CreateCall(apiFunc, args);
+    builder.CreateRetVoid();
+
+    return f;
+  }
 
-    std::vector<Constant*> meta;
-    for(const hwc::FERegionMeta& region : cfeContext.getRegions())
-      meta.push_back(processRegion(mod, region, metaTy));
+  // The runtime cannot find the metadata of a shared object on its own, so
+  // shared objects register themselves when they are loaded and unregister
+  // when they are unloaded. The constructor and destructor are keyed on
+  // themselves so that they are dropped along with the duplicate copies
+  bool addRegistration(Module& mod, GlobalVariable* gMeta) {
+    if(mod.getFunction(".hwcinstr.register"))
+      return false;
+
+    Function* ctor = createRegistration(
+        mod, ".hwcinstr.register", hwc::getFuncRegisterModule(), gMeta);
+    Function* dtor = createRegistration(
+        mod, ".hwcinstr.unregister", hwc::getFuncUnregisterModule(), gMeta);
+    appendToGlobalCtors(mod, ctor, 1, ctor);
+    appendToGlobalDtors(mod, dtor, 1, dtor);
+
+    return true;
+  }
 
-    ArrayType* aty = ArrayType::get(metaTy, meta.size());
-    Constant* cMeta = ConstantArray::get(aty, meta);
+  // The runtime finds the metadata sections of the executable through this
+  // symbol. It is defined in every module but only one copy will be kept by
+  // the linker. Nothing needs to be done at startup for it to be found. In
+  // shared objects, it is hidden so it cannot be confused with the one in
+  // the executable
+  bool processMeta(Module& mod,
+                   StructType* funcMetaTy,
+                   StructType* regionMetaTy,
+                   StructType* sledTy) {
+    const std::string& secFuncs = hwc::getSecFuncMeta();
+    const std::string& secRegions = hwc::getSecRegionMeta();
+    const std::string& secSleds = hwc::getSecSleds();
+    Constant* fields[]
+        = {getSectionBound(mod, "__start_" + secFuncs, funcMetaTy),
+           getSectionBound(mod, "__stop_" + secFuncs, funcMetaTy),
+           getSectionBound(mod, "__start_" + secRegions, regionMetaTy),
+           getSectionBound(mod, "__stop_" + secRegions, regionMetaTy),
+           getSectionBound(mod, "__start_" + secSleds, sledTy),
+           getSectionBound(mod, "__stop_" + secSleds, sledTy)};
+    Constant* cMeta = ConstantStruct::getAnon(fields);
 
     auto* gMeta = cast<GlobalVariable>(
-        mod.getOrInsertGlobal(hwc::getSymRegionMeta(), cMeta->getType()));
+        mod.getOrInsertGlobal(hwc::getSymMeta(), cMeta->getType()));
     gMeta->setConstant(true);
-    gMeta->setLinkage(GlobalValue::ExternalLinkage);
+    gMeta->setLinkage(GlobalValue::LinkOnceODRLinkage);
+    gMeta->setComdat(mod.getOrInsertComdat(hwc::getSymMeta()));
     gMeta->setInitializer(cMeta);
+    appendToCompilerUsed(mod, {gMeta});
 
-    auto* gNumMeta = cast<GlobalVariable>(mod.getOrInsertGlobal(
-        hwc::getSymNumRegionMeta(), hwc::getType<unsigned>(mod)));
-    gNumMeta->setConstant(true);
-    gNumMeta->setLinkage(GlobalValue::ExternalLinkage);
-    gNumMeta->setInitializer(hwc::getConstant<unsigned>(meta.size(), mod));
+    if(isSharedObject(mod)) {
+      gMeta->setVisibility(GlobalValue::HiddenVisibility);
+      addRegistration(mod, gMeta);
+    }
 
-    return changed;
+    return true;
   }
 
   virtual bool runOnModule(Module& mod) override {
+    PhaseTimer timer(CFEContext::Phase::GenerateSymbols);
     bool changed = false;
 
-    changed |= processFunctions(mod);
-    changed |= processRegions(mod);
+    StructType* funcMetaTy = mod.getTypeByName("hwc::FuncMeta");
+    if(not funcMetaTy)
+      funcMetaTy = createFuncMetaTy(mod);
+
+    StructType* regionMetaTy = mod.getTypeByName("hwc::RegionMeta");
+    if(not regionMetaTy)
+      regionMetaTy = createRegionMetaTy(mod);
+
+    StructType* sledTy = mod.getTypeByName("hwc::Sled");
+    if(not sledTy)
+      sledTy = createSledTy(mod);
+
+    changed |= processFunctions(mod, funcMetaTy);
+    changed |= processRegions(mod, regionMetaTy);
+    changed |= processMeta(mod, funcMetaTy, regionMetaTy, sledTy);
 
     return changed;
   }
@@ -206,6 +352,17 @@ public:
 
 char GenerateSymbolsPass::ID = 0;
 
+namespace hwc {
+
+PreservedAnalyses GenerateSymbols::run(Module& mod, ModuleAnalysisManager&) {
+  GenerateSymbolsPass pass;
+  if(pass.runOnModule(mod))
+    return PreservedAnalyses::none();
+  return PreservedAnalyses::all();
+}
+
+} // namespace hwc
+
 static void registerPass(const PassManagerBuilder&,
                          legacy::PassManagerBase& pm) {
   pm.add(new GenerateSymbolsPass());
@@ -15,6 +15,7 @@
 #include "CFEContext.h"
 #include "ConvertTypes.h"
 #include "ConvertConstants.h"
+#include "PhaseTimer.h"
 #include "common/SymbolNames.h"
 
 #include <llvm/IR/IRBuilder.h>
@@ -147,6 +148,7 @@ public:
   }
 
   virtual bool runOnModule(Module& mod) override {
+    PhaseTimer timer(CFEContext::Phase::GenerateWrappers);
     bool changed = false;
     IRBuilder<> builder(mod.getContext());
 
@@ -165,7 +167,10 @@ char GenerateWrappersPass::ID = 0;
 
 static void registerPass(const PassManagerBuilder&,
                          legacy::PassManagerBase& pm) {
-  pm.add(new GenerateWrappersPass());
+  // In the late mode, the functions are instrumented in place by
+  // InstrumentFunctionsPass instead
+  if(CFEContext::getSingleton().getMode() == CFEContext::Mode::Wrapper)
+    pm.add(new GenerateWrappersPass());
 }
 
 static RegisterStandardPasses
@@ -0,0 +1,165 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "CFEContext.h"
+#include "ConvertConstants.h"
+#include "ConvertTypes.h"
+#include "Passes.h"
+#include "PhaseTimer.h"
+#include "common/SymbolNames.h"
+
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/Pass.h>
+#include <llvm/Transforms/IPO/PassManagerBuilder.h>
+#include <llvm/Transforms/Utils/BasicBlockUtils.h>
+
+using namespace llvm;
+
+static Function* getAPIFunction(Module& mod, const std::string& fname) {
+  LLVMContext& llvmContext = mod.getContext();
+  Type* params[] = {hwc::getType<FunctionID>(mod)};
+  FunctionType* fty
+      = FunctionType::get(Type::getVoidTy(llvmContext), params, false);
+  Function* f = cast<Function>(mod.getOrInsertFunction(fname, fty));
+  f->addFnAttr(Attribute::AttrKind::NoUnwind);
+
+  return f;
+}
+
+// The exit call cannot be added to the destinations of an invoke directly
+// because they could be reached from elsewhere. A block that is only reached
+// from the invoke is put in between. The landing pad is copied into it if it
+// is the unwind destination
+static BasicBlock* getOwnDest(InvokeInst* invoke, BasicBlock* dest) {
+  BasicBlock* preds[] = {invoke->getParent()};
+  return SplitBlockPredecessors(dest, preds, ".hwcinstr");
+}
+
+static bool instrumentCall(Instruction* inst,
+                           FunctionID id,
+                           Function* enterFunc,
+                           Function* exitFunc) {
+  Module& mod = *inst->getModule();
+  Value* args[] = {hwc::getConstant(id, mod)};
+
+  // Nothing can be added after a musttail call. Funclet-based exception
+  // handling is not supported
+  std::vector<Instruction*> exits;
+  if(auto* call = dyn_cast<CallInst>(inst)) {
+    if(call->isMustTailCall())
+      return false;
+    call->setTailCall(false);
+    exits.push_back(call->getNextNode());
+  } else if(auto* invoke = dyn_cast<InvokeInst>(inst)) {
+    if(not invoke->getUnwindDest()->isLandingPad())
+      return false;
+    BasicBlock* normal = getOwnDest(invoke, invoke->getNormalDest());
+    BasicBlock* unwind = getOwnDest(invoke, invoke->getUnwindDest());
+    exits.push_back(&*normal->getFirstInsertionPt());
+    exits.push_back(&*unwind->getFirstInsertionPt());
+  }
+
+  IRBuilder<> builder(inst);
+  builder.SetCurrentDebugLocation(inst->getDebugLoc());
+  builder.CreateCall(enterFunc->getFunctionType(), enterFunc, args);
+  for(Instruction* exit : exits) {
+    builder.SetInsertPoint(exit);
+    builder.SetCurrentDebugLocation(inst->getDebugLoc());
+    builder.CreateCall(exitFunc->getFunctionType(), exitFunc, args);
+  }
+
+  return true;
+}
+
+// Calls to functions that are defined in libraries which cannot be
+// recompiled, such as BLAS or libm, are measured at every call site in the
+// instrumented code. Only direct calls are instrumented. The calls are added
+// early, in every mode, because the CFEContext is needed to know which
+// functions to look for. Calls that the compiler turns into intrinsics, such
+// as memcpy with a known size, are not seen
+static bool instrumentCalls(Module& mod) {
+  PhaseTimer timer(CFEContext::Phase::InstrumentCalls);
+  CFEContext& cfeContext = CFEContext::getSingleton();
+
+  std::vector<std::pair<Instruction*, const hwc::FEFuncMeta*>> calls;
+  for(Function& f : mod.functions())
+    for(BasicBlock& bb : f)
+      for(Instruction& inst : bb) {
+        Function* callee = nullptr;
+        if(auto* call = dyn_cast<CallInst>(&inst))
+          callee = call->getCalledFunction();
+        else if(auto* invoke = dyn_cast<InvokeInst>(&inst))
+          callee = invoke->getCalledFunction();
+        if(callee)
+          if(const hwc::FEFuncMeta* meta = cfeContext.getCallee(*callee))
+            calls.emplace_back(&inst, meta);
+      }
+  if(calls.empty())
+    return false;
+
+  Function* enterFunc = getAPIFunction(mod, hwc::getFuncEnterFunc());
+  Function* exitFunc = getAPIFunction(mod, hwc::getFuncExitFunc());
+  bool changed = false;
+  for(const auto& i : calls)
+    changed |= instrumentCall(i.first, i.second->id, enterFunc, exitFunc);
+
+  return changed;
+}
+
+class InstrumentCallsPass : public ModulePass {
+public:
+  static char ID;
+
+public:
+  InstrumentCallsPass() : ModulePass(ID) {
+    ;
+  }
+
+  virtual StringRef getPassName() const override {
+    return "hwcinstr-calls";
+  }
+
+  virtual void getAnalysisUsage(AnalysisUsage&) const override {
+    ;
+  }
+
+  virtual bool runOnModule(Module& mod) override {
+    return instrumentCalls(mod);
+  }
+};
+
+char InstrumentCallsPass::ID = 0;
+
+namespace hwc {
+
+PreservedAnalyses InstrumentCalls::run(Module& mod, ModuleAnalysisManager&) {
+  if(not instrumentCalls(mod))
+    return PreservedAnalyses::all();
+  return PreservedAnalyses::none();
+}
+
+} // namespace hwc
+
+static void registerPass(const PassManagerBuilder&,
+                         legacy::PassManagerBase& pm) {
+  pm.add(new InstrumentCallsPass());
+}
+
+static RegisterStandardPasses
+    registerEarly(PassManagerBuilder::EP_ModuleOptimizerEarly, registerPass);
+
+static RegisterStandardPasses
+    registerOpt0(PassManagerBuilder::EP_EnabledOnOptLevel0, registerPass);
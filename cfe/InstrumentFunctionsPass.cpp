@@ -0,0 +1,313 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "CFEContext.h"
+#include "ConvertConstants.h"
+#include "ConvertTypes.h"
+#include "Passes.h"
+#include "PhaseTimer.h"
+#include "common/SymbolNames.h"
+
+#include <llvm/ADT/Triple.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/InlineAsm.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/Pass.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/IPO/PassManagerBuilder.h>
+
+using namespace llvm;
+
+static const std::string attrFuncID = "hwcinstr-func-id";
+static const std::string attrSled = "hwcinstr-sled";
+
+namespace hwc {
+
+const std::string& getAttrFuncID() {
+  return attrFuncID;
+}
+
+} // namespace hwc
+
+// In the late mode, the functions to be instrumented are only marked early in
+// the pipeline. The calls to the runtime are added after all the
+// optimizations (including LTO) have been run so the code that is measured
+// is as close as possible to the code that would have been generated without
+// any instrumentation. The only things that are needed late are the function
+// ID and whether sleds should be added and those are saved as attributes
+static bool markFunctions(Module& mod) {
+  PhaseTimer timer(CFEContext::Phase::MarkFunctions);
+  bool changed = false;
+
+  // The sleds and the code that patches them are specific to x86-64 and the
+  // records are placed in sections using the ELF assembler syntax
+  CFEContext& cfeContext = CFEContext::getSingleton();
+  bool sleds = cfeContext.getMode() == CFEContext::Mode::Sled;
+  Triple triple(mod.getTargetTriple());
+  bool supported
+      = triple.getArch() == Triple::x86_64 and triple.isOSBinFormatELF();
+  if(sleds and not supported) {
+    errs() << "hwcinstr: Sleds are not supported on " << triple.str()
+           << ". Calls will be added instead\n";
+    sleds = false;
+  }
+
+  for(Function& f : mod.functions()) {
+    if(cfeContext.shouldInstrument(f)) {
+      const hwc::FEFuncMeta& meta = cfeContext.getFuncMeta(f);
+      f.addFnAttr(hwc::getAttrFuncID(), std::to_string(meta.id));
+      if(sleds)
+        f.addFnAttr(attrSled);
+      changed = true;
+    }
+  }
+
+  return changed;
+}
+
+static Function* getAPIFunction(Module& mod, const std::string& fname) {
+  LLVMContext& llvmContext = mod.getContext();
+  Type* params[] = {hwc::getType<FunctionID>(mod)};
+  FunctionType* fty
+      = FunctionType::get(Type::getVoidTy(llvmContext), params, false);
+  Function* f = cast<Function>(mod.getOrInsertFunction(fname, fty));
+  f->addFnAttr(Attribute::AttrKind::NoUnwind);
+
+  return f;
+}
+
+// Returns the instruction before which the exit call must be added for the
+// given terminator. A musttail call must always be followed by the return, so
+// the exit call is added before it and the callee is left out of the
+// measurement. Any other call before the return is kept inside it like it is
+// in the wrapper mode. Such a call can no longer be turned into a jump, so it
+// is no longer marked as a tail call
+static Instruction* getExitInsertPt(ReturnInst* ret) {
+  Instruction* prev = ret->getPrevNode();
+  if(prev and isa<BitCastInst>(prev))
+    prev = prev->getPrevNode();
+  if(auto* call = dyn_cast_or_null<CallInst>(prev)) {
+    if(call->isMustTailCall())
+      return call;
+    call->setTailCall(false);
+  }
+  return ret;
+}
+
+// The sled is a two-byte jump over nine bytes of padding. When it is patched,
+// the jump is replaced with an instruction that loads the address of the
+// record of the sled into r11 and the padding with an indirect call to the
+// trampoline whose address the runtime saves in the record. The trampoline
+// preserves everything but r11 and the flags. The record is in the same
+// COMDAT group as the function so it is dropped along with any duplicates
+static void addSled(IRBuilder<>& builder,
+                    Function& f,
+                    FunctionID id,
+                    hwc::RTSled::Kind kind) {
+  std::string section = hwc::getSecSleds() + ",\"aw\",@progbits";
+  if(const Comdat* comdat = f.getComdat())
+    section = hwc::getSecSleds() + ",\"awG\",@progbits,"
+              + comdat->getName().str() + ",comdat";
+
+  std::string code;
+  raw_string_ostream ss(code);
+  ss << ".p2align 1\n"
+     << ".Lhwc_sled${:uid}:\n"
+     << ".byte 0xeb, 0x09, 0x66, 0x0f, 0x1f, 0x84, 0x00, 0x00, 0x00, 0x00, "
+     << "0x00\n"
+     << ".pushsection " << section << "\n"
+     << ".p2align 3\n"
+     << ".quad .Lhwc_sled${:uid}\n"
+     << ".quad " << id << "\n"
+     << ".quad " << kind << "\n"
+     << ".quad 0\n"
+     << ".popsection";
+
+  FunctionType* fty = FunctionType::get(builder.getVoidTy(), false);
+  InlineAsm* sled = InlineAsm::get(
+      fty, ss.str(), "~{r11},~{dirflag},~{fpsr},~{flags}", true);
+  builder.CreateCall(fty, sled);
+}
+
+static bool instrumentFunction(Function& f) {
+  PhaseTimer timer(CFEContext::Phase::InstrumentFunctions);
+  if(not f.hasFnAttribute(hwc::getAttrFuncID()) or f.isDeclaration())
+    return false;
+
+  Module& mod = *f.getParent();
+  FunctionID id = 0;
+  f.getFnAttribute(hwc::getAttrFuncID()).getValueAsString().getAsInteger(10,
+                                                                         id);
+
+  // The attribute is removed so that the function is not instrumented more
+  // than once if the late passes get run more than once, for instance, both
+  // before and during LTO
+  f.removeFnAttr(hwc::getAttrFuncID());
+
+  // The patched sleds call the trampoline without moving the stack pointer
+  // first, so anything the function keeps below it would be overwritten
+  bool sleds = f.hasFnAttribute(attrSled);
+  if(sleds) {
+    f.removeFnAttr(attrSled);
+    f.addFnAttr(Attribute::AttrKind::NoRedZone);
+  }
+
+  Function* enterFunc = getAPIFunction(mod, hwc::getFuncEnterFunc());
+  Function* exitFunc = getAPIFunction(mod, hwc::getFuncExitFunc());
+  Value* args[] = {hwc::getConstant(id, mod)};
+
+  // The enter call is added after any static allocas so they remain static
+  BasicBlock::iterator it = f.getEntryBlock().getFirstInsertionPt();
+  while(isa<AllocaInst>(*it))
+    it++;
+  IRBuilder<> builder(&*it);
+  if(sleds)
+    addSled(builder, f, id, hwc::RTSled::Entry);
+  else
+    builder.CreateCall(enterFunc->getFunctionType(), enterFunc, args);
+
+  // The exit call is added at every point where control leaves the function.
+  // Exceptions that are propagated out of the function are only seen when
+  // the function has a landing pad of its own
+  std::vector<Instruction*> exits;
+  for(BasicBlock& bb : f) {
+    if(auto* ret = dyn_cast<ReturnInst>(bb.getTerminator()))
+      exits.push_back(getExitInsertPt(ret));
+    else if(auto* resume = dyn_cast<ResumeInst>(bb.getTerminator()))
+      exits.push_back(resume);
+  }
+
+  for(Instruction* inst : exits) {
+    builder.SetInsertPoint(inst);
+    builder.SetCurrentDebugLocation(inst->getDebugLoc());
+    if(sleds)
+      addSled(builder, f, id, hwc::RTSled::Exit);
+    else
+      builder.CreateCall(exitFunc->getFunctionType(), exitFunc, args);
+  }
+
+  return true;
+}
+
+// Marks the functions to be instrumented in the late mode
+class MarkFunctionsPass : public ModulePass {
+public:
+  static char ID;
+
+public:
+  MarkFunctionsPass() : ModulePass(ID) {
+    ;
+  }
+
+  virtual StringRef getPassName() const override {
+    return "hwcinstr-mark";
+  }
+
+  virtual void getAnalysisUsage(AnalysisUsage& AU) const override {
+    AU.setPreservesAll();
+  }
+
+  virtual bool runOnModule(Module& mod) override {
+    return markFunctions(mod);
+  }
+};
+
+// Adds the calls to the instrumentation library directly to the body of the
+// functions that were marked earlier. The call to enter the function is
+// added at the start of the function and the call to exit the function is
+// added before every return
+class InstrumentFunctionsPass : public FunctionPass {
+public:
+  static char ID;
+
+public:
+  InstrumentFunctionsPass() : FunctionPass(ID) {
+    ;
+  }
+
+  virtual StringRef getPassName() const override {
+    return "hwcinstr-instrument";
+  }
+
+  virtual void getAnalysisUsage(AnalysisUsage& AU) const override {
+    AU.setPreservesCFG();
+  }
+
+  virtual bool runOnFunction(Function& f) override {
+    return instrumentFunction(f);
+  }
+};
+
+char MarkFunctionsPass::ID = 0;
+char InstrumentFunctionsPass::ID = 0;
+
+namespace hwc {
+
+PreservedAnalyses MarkFunctions::run(Module& mod, ModuleAnalysisManager&) {
+  markFunctions(mod);
+  return PreservedAnalyses::all();
+}
+
+PreservedAnalyses InstrumentFunctions::run(Function& f,
+                                           FunctionAnalysisManager&) {
+  if(not instrumentFunction(f))
+    return PreservedAnalyses::all();
+
+  PreservedAnalyses pa;
+  pa.preserveSet<CFGAnalyses>();
+  return pa;
+}
+
+} // namespace hwc
+
+static bool isLate() {
+  CFEContext::Mode mode = CFEContext::getSingleton().getMode();
+  return mode == CFEContext::Mode::Late or mode == CFEContext::Mode::Sled;
+}
+
+static void registerMarkPass(const PassManagerBuilder&,
+                             legacy::PassManagerBase& pm) {
+  if(isLate())
+    pm.add(new MarkFunctionsPass());
+}
+
+// The instrumentation pass does not look at the CFEContext, so it is always
+// added. It will do nothing if none of the functions have been marked
+static void registerInstrumentPass(const PassManagerBuilder&,
+                                   legacy::PassManagerBase& pm) {
+  pm.add(new InstrumentFunctionsPass());
+}
+
+// The order of registration matters at -O0 where both passes are run at the
+// same extension point
+static RegisterStandardPasses
+    registerMarkEarly(PassManagerBuilder::EP_ModuleOptimizerEarly,
+                      registerMarkPass);
+
+static RegisterStandardPasses
+    registerMarkOpt0(PassManagerBuilder::EP_EnabledOnOptLevel0,
+                     registerMarkPass);
+
+static RegisterStandardPasses
+    registerInstrumentLast(PassManagerBuilder::EP_OptimizerLast,
+                           registerInstrumentPass);
+
+static RegisterStandardPasses
+    registerInstrumentLTO(PassManagerBuilder::EP_FullLinkTimeOptimizationLast,
+                          registerInstrumentPass);
+
+static RegisterStandardPasses
+    registerInstrumentOpt0(PassManagerBuilder::EP_EnabledOnOptLevel0,
+                           registerInstrumentPass);
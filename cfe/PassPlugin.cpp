@@ -0,0 +1,88 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Passes.h"
+
+#include <llvm/Config/llvm-config.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Passes/PassPlugin.h>
+
+using namespace llvm;
+
+// Entry point for the new pass manager. Only the late mode is supported here.
+// The functions are marked and the metadata symbols are generated at the
+// start of the pipeline while the CFEContext is still valid. The
+// instrumentation itself is added once the optimization pipeline is done.
+//
+// The passes can also be named explicitly in a pipeline. This is needed for
+// full LTO with the new pass manager which does not have an extension point
+// at the end of the pipeline:
+//
+//   hwcinstr-mark, hwcinstr-symbols, hwcinstr-instrument
+//
+// The calls to functions in other libraries are instrumented at the start of
+// the pipeline by hwcinstr-calls since that also needs the CFEContext. So are
+// the hints from an earlier run added by hwcinstr-profile
+//
+static void registerCallbacks(PassBuilder& pb) {
+  pb.registerPipelineStartEPCallback([](ModulePassManager& mpm) {
+    mpm.addPass(hwc::ApplyProfile());
+    mpm.addPass(hwc::MarkFunctions());
+    mpm.addPass(hwc::InstrumentCalls());
+    mpm.addPass(hwc::GenerateSymbols());
+  });
+
+  pb.registerOptimizerLastEPCallback(
+      [](FunctionPassManager& fpm, PassBuilder::OptimizationLevel) {
+        fpm.addPass(hwc::InstrumentFunctions());
+      });
+
+  pb.registerPipelineParsingCallback(
+      [](StringRef name,
+         ModulePassManager& mpm,
+         ArrayRef<PassBuilder::PipelineElement>) {
+        if(name == "hwcinstr-mark") {
+          mpm.addPass(hwc::MarkFunctions());
+          return true;
+        } else if(name == "hwcinstr-symbols") {
+          mpm.addPass(hwc::GenerateSymbols());
+          return true;
+        } else if(name == "hwcinstr-calls") {
+          mpm.addPass(hwc::InstrumentCalls());
+          return true;
+        } else if(name == "hwcinstr-profile") {
+          mpm.addPass(hwc::ApplyProfile());
+          return true;
+        }
+        return false;
+      });
+
+  pb.registerPipelineParsingCallback(
+      [](StringRef name,
+         FunctionPassManager& fpm,
+         ArrayRef<PassBuilder::PipelineElement>) {
+        if(name == "hwcinstr-instrument") {
+          fpm.addPass(hwc::InstrumentFunctions());
+          return true;
+        }
+        return false;
+      });
+}
+
+extern "C" LLVM_ATTRIBUTE_WEAK PassPluginLibraryInfo llvmGetPassPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION,
+          "hwcinstr",
+          LLVM_VERSION_STRING,
+          registerCallbacks};
+}
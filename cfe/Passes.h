@@ -0,0 +1,57 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef HWC_PASSES_H
+#define HWC_PASSES_H
+
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/PassManager.h>
+
+namespace hwc {
+
+// The name of the function attribute that is used to mark the functions that
+// must be instrumented in the late mode. The value of the attribute is the
+// ID of the function. It is kept in the IR so that the functions can still be
+// instrumented when the CFEContext is no longer around such as when the
+// instrumentation is done at link-time
+const std::string& getAttrFuncID();
+
+// Versions of the passes that can be used with the new pass manager. These
+// are registered through the pass plugin interface
+
+struct GenerateSymbols : public llvm::PassInfoMixin<GenerateSymbols> {
+  llvm::PreservedAnalyses run(llvm::Module& mod, llvm::ModuleAnalysisManager&);
+};
+
+struct MarkFunctions : public llvm::PassInfoMixin<MarkFunctions> {
+  llvm::PreservedAnalyses run(llvm::Module& mod, llvm::ModuleAnalysisManager&);
+};
+
+struct InstrumentFunctions : public llvm::PassInfoMixin<InstrumentFunctions> {
+  llvm::PreservedAnalyses run(llvm::Function& f,
+                              llvm::FunctionAnalysisManager&);
+};
+
+struct InstrumentCalls : public llvm::PassInfoMixin<InstrumentCalls> {
+  llvm::PreservedAnalyses run(llvm::Module& mod, llvm::ModuleAnalysisManager&);
+};
+
+struct ApplyProfile : public llvm::PassInfoMixin<ApplyProfile> {
+  llvm::PreservedAnalyses run(llvm::Module& mod, llvm::ModuleAnalysisManager&);
+};
+
+} // namespace hwc
+
+#endif // HWC_PASSES_H
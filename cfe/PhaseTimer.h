@@ -0,0 +1,46 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef HWC_PHASE_TIMER_H
+#define HWC_PHASE_TIMER_H
+
+#include "CFEContext.h"
+
+#include <chrono>
+
+// Adds the time between its construction and destruction to the given phase
+// of the plugin
+class PhaseTimer {
+protected:
+  using Clock = std::chrono::steady_clock;
+
+  CFEContext::Phase phase;
+  Clock::time_point start;
+
+public:
+  PhaseTimer(CFEContext::Phase phase) : phase(phase), start(Clock::now()) {
+    ;
+  }
+
+  PhaseTimer(const PhaseTimer&) = delete;
+  PhaseTimer(PhaseTimer&&) = delete;
+
+  ~PhaseTimer() {
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now() - start);
+    CFEContext::getSingleton().addPhaseTime(phase, ns.count());
+  }
+};
+
+#endif // HWC_PHASE_TIMER_H
@@ -25,15 +25,21 @@
 #define FUNC_NAME(fn) SYM_NAME(HWC_PREFIX, fn)
 #define GV_NAME(g) SYM_NAME(HWC_PREFIX, g)
 
-#define HWC_GV_META_FUNC GV_NAME(gv_meta_func)
-#define HWC_GV_NUM_META_FUNC GV_NAME(gv_num_meta_func)
-#define HWC_GV_META_REGION GV_NAME(gv_meta_region)
-#define HWC_GV_NUM_META_REGION GV_NAME(gv_num_meta_region)
+#define HWC_GV_META GV_NAME(gv_meta)
+
+// The metadata records are placed in these sections. The names must be valid
+// C identifiers so the linker defines the __start_ and __stop_ symbols
+#define HWC_SEC_META_FUNC hwcinstr_meta_func
+#define HWC_SEC_META_REGION hwcinstr_meta_region
+#define HWC_SEC_SLEDS hwcinstr_sleds
 
 #define HWC_ENTER_FUNC FUNC_NAME(enter_func)
 #define HWC_EXIT_FUNC FUNC_NAME(exit_func)
 #define HWC_ENTER_REGION FUNC_NAME(enter_region)
 #define HWC_EXIT_REGION FUNC_NAME(exit_region)
+#define HWC_REGISTER_MODULE FUNC_NAME(register_module)
+#define HWC_UNREGISTER_MODULE FUNC_NAME(unregister_module)
+#define HWC_SLED_HANDLER FUNC_NAME(sled_handler)
 
 extern "C" {
 
@@ -42,6 +48,13 @@ void HWC_EXIT_FUNC(FunctionID id);
 void HWC_ENTER_REGION(RegionID id);
 void HWC_EXIT_REGION(RegionID id);
 
+// Called by instrumented shared objects when they are loaded and unloaded
+void HWC_REGISTER_MODULE(const hwc::RTMeta* meta);
+void HWC_UNREGISTER_MODULE(const hwc::RTMeta* meta);
+
+// Called through the trampoline when a patched sled is executed
+void HWC_SLED_HANDLER(const hwc::RTSled* sled);
+
 } // extern "C"
 
 #endif // HWC_API_H
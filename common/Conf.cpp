@@ -201,7 +201,7 @@ public:
   }
 };
 
-Conf::Conf(const PAPIContext& papiContext) : papiContext(papiContext) {
+Conf::Conf(const CounterBackend& backend) : backend(backend) {
   ;
 }
 
@@ -292,12 +292,12 @@ bool Conf::parse(const std::string& file) {
     if(not check(root))
       return fail();
 
-    std::vector<CounterID> counters;
+    std::vector<std::string> counters;
     const YAMLMap* map = static_cast<const YAMLMap*>(root);
     if(map->has("counters")) {
       const YAMLList* list = static_cast<const YAMLList*>(map->get("counters"));
       for(const YAMLNode& elem : *list)
-        counters.push_back(papiContext.getCounterID(
+        counters.push_back(hwc::normalizeCounterName(
             static_cast<const YAMLScalar&>(elem).get()));
     }
 
@@ -308,6 +308,22 @@ bool Conf::parse(const std::string& file) {
         funcs[static_cast<const YAMLScalar&>(elem).get()] = counters;
     }
 
+    // Pinned functions do not also have to be listed with the others
+    if(map->has("pinned")) {
+      const YAMLList* fns = static_cast<const YAMLList*>(map->get("pinned"));
+      for(const YAMLNode& elem : *fns) {
+        const std::string& func = static_cast<const YAMLScalar&>(elem).get();
+        funcs[func] = counters;
+        pinned.insert(func);
+      }
+    }
+
+    if(map->has("calls")) {
+      const YAMLList* fns = static_cast<const YAMLList*>(map->get("calls"));
+      for(const YAMLNode& elem : *fns)
+        calls[static_cast<const YAMLScalar&>(elem).get()] = counters;
+    }
+
     delete root;
   } else {
     fail();
@@ -321,7 +337,8 @@ bool Conf::check(const YAMLNode* root) {
     return fail("Root of the config file should be a map");
 
   const YAMLMap* map = static_cast<const YAMLMap*>(root);
-  std::set<std::string> keys = {"counters", "functions", "regions"};
+  std::set<std::string> keys
+      = {"calls", "counters", "functions", "pinned", "regions"};
   for(const auto& i : *map) {
     const std::string& key = i.first;
     if(keys.find(key) == keys.end())
@@ -337,8 +354,10 @@ bool Conf::check(const YAMLNode* root) {
       if(elem.getKind() != YAMLNode::Scalar)
         return fail("Counter element must be a scalar");
       const YAMLScalar& scalar = static_cast<const YAMLScalar&>(elem);
-      if(not papiContext.isCounter(scalar.get()))
-        return fail("Counter element is not a PAPI counter: " + scalar.get());
+      std::string name = hwc::normalizeCounterName(scalar.get());
+      if(not backend.isCounter(name) and hwc::getAllocCounter(name) < 0)
+        return fail("Counter element is not a counter known to "
+                    + std::string(backend.getName()) + ": " + scalar.get());
     }
   }
 
@@ -352,6 +371,26 @@ bool Conf::check(const YAMLNode* root) {
     }
   }
 
+  if(map->has("pinned")) {
+    const YAMLNode* node = map->get("pinned");
+    if(node->getKind() != YAMLNode::List)
+      return fail("Pinned must be a list");
+    for(const YAMLNode& elem : *static_cast<const YAMLList*>(node)) {
+      if(elem.getKind() != YAMLNode::Scalar)
+        return fail("Pinned element must be a scalar");
+    }
+  }
+
+  if(map->has("calls")) {
+    const YAMLNode* node = map->get("calls");
+    if(node->getKind() != YAMLNode::List)
+      return fail("Calls must be a list");
+    for(const YAMLNode& elem : *static_cast<const YAMLList*>(node)) {
+      if(elem.getKind() != YAMLNode::Scalar)
+        return fail("Calls element must be a scalar");
+    }
+  }
+
   return true;
 }
 
@@ -359,6 +398,20 @@ bool Conf::has(const std::string& func) const {
   return funcs.find(func) != funcs.end();
 }
 
-const std::vector<CounterID>& Conf::getCounters(const std::string& func) const {
+bool Conf::isPinned(const std::string& func) const {
+  return pinned.find(func) != pinned.end();
+}
+
+const std::vector<std::string>&
+Conf::getCounters(const std::string& func) const {
   return funcs.at(func);
 }
+
+bool Conf::hasCall(const std::string& func) const {
+  return calls.find(func) != calls.end();
+}
+
+const std::vector<std::string>&
+Conf::getCallCounters(const std::string& func) const {
+  return calls.at(func);
+}
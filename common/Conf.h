@@ -15,10 +15,11 @@
 #ifndef HWC_COMMON_CONF_H
 #define HWC_COMMON_CONF_H
 
-#include "PAPIContext.h"
+#include "CounterBackend.h"
 #include "Types.h"
 
 #include <map>
+#include <set>
 #include <vector>
 #include <yaml.h>
 
@@ -31,9 +32,16 @@ class YAMLScalar;
 // instrumented and the counters to record for them
 class Conf {
 protected:
-  const PAPIContext& papiContext;
+  const CounterBackend& backend;
   yaml_parser_t parser;
-  std::map<std::string, std::vector<CounterID>> funcs;
+  std::map<std::string, std::vector<std::string>> funcs;
+
+  // The functions that are always instrumented however cheap they seem
+  std::set<std::string> pinned;
+
+  // The functions in other libraries whose calls are instrumented at every
+  // call site
+  std::map<std::string, std::vector<std::string>> calls;
   // TODO: Support regions
 
 protected:
@@ -45,14 +53,19 @@ protected:
   YAMLNode* parse(YAMLNode* curr = nullptr);
 
 public:
-  Conf(const PAPIContext& papiContext);
+  Conf(const CounterBackend& backend);
   Conf(const Conf&) = delete;
   Conf(Conf&&) = delete;
 
   bool parse(const std::string& file);
 
   bool has(const std::string& func) const;
-  const std::vector<CounterID>& getCounters(const std::string& func) const;
+  bool isPinned(const std::string& func) const;
+  const std::vector<std::string>& getCounters(const std::string& func) const;
+
+  bool hasCall(const std::string& func) const;
+  const std::vector<std::string>&
+  getCallCounters(const std::string& func) const;
 };
 
 #endif // HWC_COMMON_CONF_H
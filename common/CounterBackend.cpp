@@ -0,0 +1,123 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "CounterBackend.h"
+#include "MockBackend.h"
+#include "PerfBackend.h"
+
+#ifdef HWC_HAVE_PAPI
+#include "PAPIBackend.h"
+#endif // HWC_HAVE_PAPI
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+// The counters can be read from user space unless HWCINSTR_RDPMC is 0. This
+// is mostly useful to measure how much it helps
+static bool useRdpmc() {
+  const char* env = std::getenv("HWCINSTR_RDPMC");
+  return not env or std::string(env) != "0";
+}
+
+bool CounterBackend::isCompatible(
+    const std::vector<std::string>& counters) const {
+  std::unique_ptr<CounterSet> set = createSet();
+  for(const std::string& counter : counters)
+    if(not set->add(counter))
+      return false;
+
+  std::vector<CounterValue> values(counters.size());
+  if(not set->start())
+    return false;
+  set->stop(values.data());
+  return true;
+}
+
+std::unique_ptr<CounterBackend>
+CounterBackend::create(const std::string& name) {
+  std::string backend = name;
+  if(backend.empty())
+    if(const char* env = std::getenv("HWCINSTR_BACKEND"))
+      backend = env;
+
+  if(backend == "mock") {
+    const char* script = std::getenv("HWCINSTR_MOCK");
+    const char* slots = std::getenv("HWCINSTR_MOCK_SLOTS");
+    return std::unique_ptr<CounterBackend>(new MockBackend(
+        script ? script : "", slots ? std::strtoul(slots, nullptr, 10) : 0));
+  } else if(backend == "perf") {
+    return std::unique_ptr<CounterBackend>(new PerfBackend(useRdpmc()));
+  }
+
+#ifdef HWC_HAVE_PAPI
+  std::unique_ptr<PAPIBackend> papi(new PAPIBackend());
+  if(papi->isAvailable())
+    return std::unique_ptr<CounterBackend>(papi.release());
+  if(backend == "papi")
+    std::cerr << "hwcinstr: PAPI could not be initialized. Using "
+              << "perf_event_open instead\n";
+#else
+  if(backend == "papi")
+    std::cerr << "hwcinstr: Not built with PAPI. Using perf_event_open "
+              << "instead\n";
+#endif // HWC_HAVE_PAPI
+
+  return std::unique_ptr<CounterBackend>(new PerfBackend(useRdpmc()));
+}
+
+namespace hwc {
+
+std::string normalizeCounterName(const std::string& name) {
+  if(name.empty() or name.find("PAPI_") == 0)
+    return name;
+  for(char c : name)
+    if(not((c >= 'A' and c <= 'Z') or (c >= '0' and c <= '9') or c == '_'))
+      return name;
+  return "PAPI_" + name;
+}
+
+int getAllocCounter(const std::string& name) {
+  static const char* const names[NumAllocCounters]
+      = {"alloc-calls", "alloc-bytes", "alloc-peak", "alloc-time"};
+  for(unsigned i = 0; i < NumAllocCounters; i++)
+    if(name == names[i])
+      return i;
+  return -1;
+}
+
+int addToGroup(const CounterBackend& backend,
+               std::vector<std::vector<std::string>>& groups,
+               const std::string& counter) {
+  for(size_t i = 0; i < groups.size(); i++)
+    if(std::find(groups[i].begin(), groups[i].end(), counter)
+       != groups[i].end())
+      return i;
+
+  if(not backend.isCompatible({counter}))
+    return -1;
+
+  for(size_t i = 0; i < groups.size(); i++) {
+    std::vector<std::string> group = groups[i];
+    group.push_back(counter);
+    if(backend.isCompatible(group)) {
+      groups[i].push_back(counter);
+      return i;
+    }
+  }
+  groups.push_back({counter});
+  return groups.size() - 1;
+}
+
+} // namespace hwc
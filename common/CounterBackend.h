@@ -0,0 +1,109 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef HWC_COMMON_COUNTER_BACKEND_H
+#define HWC_COMMON_COUNTER_BACKEND_H
+
+#include "Types.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// The counters being recorded by a single thread. It must only be used by
+// the thread that created it
+class CounterSet {
+public:
+  CounterSet() = default;
+  CounterSet(const CounterSet&) = delete;
+  CounterSet(CounterSet&&) = delete;
+  virtual ~CounterSet() = default;
+
+  // Returns false if the counter is not available. Counters can only be
+  // added while the set is stopped
+  virtual bool add(const std::string& name) = 0;
+
+  // All the counters start counting from zero. Returns false if the
+  // counters could not be started
+  virtual bool start() = 0;
+
+  // The values are in the order in which the counters were added. Counters
+  // that could not be added are skipped
+  virtual void read(CounterValue* values) = 0;
+  virtual void stop(CounterValue* values) = 0;
+};
+
+// The source of the hardware and software counters. The same backend is used
+// by the compiler plugin to check the counters in the config file and by
+// the runtime to record them. The counters are always referred to by name
+class CounterBackend {
+public:
+  CounterBackend() = default;
+  CounterBackend(const CounterBackend&) = delete;
+  CounterBackend(CounterBackend&&) = delete;
+  virtual ~CounterBackend() = default;
+
+  virtual const char* getName() const = 0;
+  virtual bool isCounter(const std::string& name) const = 0;
+  virtual std::string getDescription(const std::string& name) const = 0;
+  virtual std::unique_ptr<CounterSet> createSet() const = 0;
+
+  // Returns true if all the counters can be recorded together in a single
+  // run without multiplexing. By default, they are all added to a new set
+  // which fails if the hardware cannot count them at the same time
+  virtual bool isCompatible(const std::vector<std::string>& counters) const;
+
+  // The name is one of papi, perf or mock. If it is empty, the backend is
+  // taken from HWCINSTR_BACKEND. Otherwise, PAPI is used if it is available
+  // and perf_event_open is used if it is not
+  static std::unique_ptr<CounterBackend> create(const std::string& name = "");
+};
+
+namespace hwc {
+
+// Counters named without a prefix in upper case, for instance TOT_INS, are
+// taken to be PAPI presets. This adds the PAPI_ prefix to them so the same
+// counter is always referred to by the same name
+std::string normalizeCounterName(const std::string& name);
+
+// The heap allocation counters are kept by the runtime itself rather than by
+// a backend. Allocations are charged to the innermost function or region
+// when the program is linked with the allocation hooks. The peak is the
+// largest number of bytes that were live on the thread at the time
+enum class AllocCounter {
+  Calls,
+  Bytes,
+  Peak,
+  Time,
+};
+
+constexpr unsigned NumAllocCounters = 4;
+
+// Returns -1 if the counter is not one of alloc-calls, alloc-bytes,
+// alloc-peak or alloc-time
+int getAllocCounter(const std::string& name);
+
+// Puts the counter in the first of the groups that it is compatible with, or
+// in a new group if there is none. Returns the index of the group or -1 if
+// the counter cannot be recorded at all. Adding the counters one at a time
+// like this does not always find the fewest groups, but the groups only
+// depend on the order in which the counters are added, so every run of the
+// same program splits them the same way
+int addToGroup(const CounterBackend& backend,
+               std::vector<std::vector<std::string>>& groups,
+               const std::string& counter);
+
+} // namespace hwc
+
+#endif // HWC_COMMON_COUNTER_BACKEND_H
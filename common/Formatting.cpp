@@ -28,3 +28,22 @@ std::string indent(unsigned depth) {
     ss << " ";
   return ss.str();
 }
+
+std::string quoteJSON(const std::string& s) {
+  static const char hexDigits[] = "0123456789abcdef";
+  std::string quoted = "\"";
+  for(char c : s) {
+    if(c == '"' or c == '\\') {
+      quoted.append(1, '\\').append(1, c);
+    } else if(c == '\n') {
+      quoted.append("\\n");
+    } else if(static_cast<unsigned char>(c) < 0x20) {
+      quoted.append("\\u00");
+      quoted.append(1, hexDigits[c >> 4]).append(1, hexDigits[c & 0xf]);
+    } else {
+      quoted.append(1, c);
+    }
+  }
+  quoted.append(1, '"');
+  return quoted;
+}
@@ -30,4 +30,7 @@ std::string quote(T val) {
   return ss.str();
 }
 
+// Returns the string quoted and escaped as a JSON string
+std::string quoteJSON(const std::string& s);
+
 #endif // HWC_FORMATTING
@@ -0,0 +1,90 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "MockBackend.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+class MockSet : public CounterSet {
+protected:
+  const MockBackend& backend;
+  std::vector<CounterValue> increments;
+  std::vector<CounterValue> values;
+
+public:
+  MockSet(const MockBackend& backend) : backend(backend) {
+    ;
+  }
+
+  virtual bool add(const std::string& name) override {
+    if(backend.getSlots() and increments.size() == backend.getSlots())
+      return false;
+    increments.push_back(backend.getIncrement(name));
+    values.push_back(0);
+    return true;
+  }
+
+  virtual bool start() override {
+    std::fill(values.begin(), values.end(), 0);
+    return true;
+  }
+
+  virtual void read(CounterValue* out) override {
+    for(size_t i = 0; i < values.size(); i++)
+      out[i] = (values[i] += increments[i]);
+  }
+
+  virtual void stop(CounterValue* out) override {
+    read(out);
+  }
+};
+
+MockBackend::MockBackend(const std::string& script, unsigned slots)
+    : slots(slots) {
+  size_t pos = 0;
+  while(pos < script.length()) {
+    size_t next = script.find(',', pos);
+    std::string item = script.substr(pos, next - pos);
+    size_t eq = item.find('=');
+    if(eq != std::string::npos)
+      increments[hwc::normalizeCounterName(item.substr(0, eq))]
+          = std::strtoll(item.substr(eq + 1).c_str(), nullptr, 10);
+    pos = (next == std::string::npos) ? next : next + 1;
+  }
+}
+
+CounterValue MockBackend::getIncrement(const std::string& name) const {
+  auto it = increments.find(hwc::normalizeCounterName(name));
+  if(it == increments.end())
+    return 1;
+  return it->second;
+}
+
+const char* MockBackend::getName() const {
+  return "mock";
+}
+
+bool MockBackend::isCounter(const std::string&) const {
+  return true;
+}
+
+std::string MockBackend::getDescription(const std::string& name) const {
+  return name;
+}
+
+std::unique_ptr<CounterSet> MockBackend::createSet() const {
+  return std::unique_ptr<CounterSet>(new MockSet(*this));
+}
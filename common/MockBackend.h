@@ -0,0 +1,49 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef HWC_COMMON_MOCK_BACKEND_H
+#define HWC_COMMON_MOCK_BACKEND_H
+
+#include "CounterBackend.h"
+
+#include <map>
+
+// A backend that does not touch the hardware and produces the same values on
+// every run. Any counter name is accepted. Each time a counter is read, its
+// value increases by a fixed amount. The amounts are given by a script of the
+// form "name=amount,name=amount". The amount is 1 for any counter that is
+// not in the script. If the number of slots is not zero, a set cannot have
+// more counters than that, like a PMU with a fixed number of counters
+class MockBackend : public CounterBackend {
+protected:
+  std::map<std::string, CounterValue> increments;
+  unsigned slots;
+
+public:
+  MockBackend(const std::string& script, unsigned slots = 0);
+  virtual ~MockBackend() = default;
+
+  CounterValue getIncrement(const std::string& name) const;
+
+  unsigned getSlots() const {
+    return slots;
+  }
+
+  virtual const char* getName() const override;
+  virtual bool isCounter(const std::string& name) const override;
+  virtual std::string getDescription(const std::string& name) const override;
+  virtual std::unique_ptr<CounterSet> createSet() const override;
+};
+
+#endif // HWC_COMMON_MOCK_BACKEND_H
@@ -0,0 +1,100 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "PAPIBackend.h"
+
+#include <papi.h>
+#include <pthread.h>
+
+#include <vector>
+
+// Each thread has its own event set
+class PAPISet : public CounterSet {
+protected:
+  int eventSet;
+
+public:
+  PAPISet() : eventSet(PAPI_NULL) {
+    PAPI_register_thread();
+    PAPI_create_eventset(&eventSet);
+  }
+
+  virtual ~PAPISet() {
+    if(eventSet != PAPI_NULL) {
+      PAPI_cleanup_eventset(eventSet);
+      PAPI_destroy_eventset(&eventSet);
+    }
+    PAPI_unregister_thread();
+  }
+
+  virtual bool add(const std::string& name) override {
+    int code;
+    std::vector<char> buf(name.begin(), name.end());
+    buf.push_back('\0');
+    if(PAPI_event_name_to_code(buf.data(), &code) != PAPI_OK)
+      return false;
+    return PAPI_add_event(eventSet, code) == PAPI_OK;
+  }
+
+  virtual bool start() override {
+    return PAPI_start(eventSet) == PAPI_OK;
+  }
+
+  virtual void read(CounterValue* values) override {
+    PAPI_read(eventSet, values);
+  }
+
+  virtual void stop(CounterValue* values) override {
+    PAPI_stop(eventSet, values);
+  }
+};
+
+static unsigned long getThreadID() {
+  return static_cast<unsigned long>(pthread_self());
+}
+
+PAPIBackend::PAPIBackend() : available(false) {
+  if(PAPI_library_init(PAPI_VER_CURRENT) != PAPI_VER_CURRENT)
+    return;
+
+  // Each thread has its own event set, so PAPI has to be told how to tell
+  // the threads apart
+  available = (PAPI_thread_init(getThreadID) == PAPI_OK);
+}
+
+const char* PAPIBackend::getName() const {
+  return "papi";
+}
+
+bool PAPIBackend::isCounter(const std::string& name) const {
+  int code;
+  std::vector<char> buf(name.begin(), name.end());
+  buf.push_back('\0');
+  return PAPI_event_name_to_code(buf.data(), &code) == PAPI_OK;
+}
+
+std::string PAPIBackend::getDescription(const std::string& name) const {
+  int code;
+  PAPI_event_info_t info;
+  std::vector<char> buf(name.begin(), name.end());
+  buf.push_back('\0');
+  if(PAPI_event_name_to_code(buf.data(), &code) != PAPI_OK
+     or PAPI_get_event_info(code, &info) != PAPI_OK or not info.short_descr[0])
+    return name;
+  return info.short_descr;
+}
+
+std::unique_ptr<CounterSet> PAPIBackend::createSet() const {
+  return std::unique_ptr<CounterSet>(new PAPISet());
+}
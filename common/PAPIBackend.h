@@ -0,0 +1,40 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef HWC_COMMON_PAPI_BACKEND_H
+#define HWC_COMMON_PAPI_BACKEND_H
+
+#include "CounterBackend.h"
+
+// Records the counters using PAPI. Any preset or native event that PAPI
+// knows about can be used
+class PAPIBackend : public CounterBackend {
+protected:
+  bool available;
+
+public:
+  PAPIBackend();
+  virtual ~PAPIBackend() = default;
+
+  bool isAvailable() const {
+    return available;
+  }
+
+  virtual const char* getName() const override;
+  virtual bool isCounter(const std::string& name) const override;
+  virtual std::string getDescription(const std::string& name) const override;
+  virtual std::unique_ptr<CounterSet> createSet() const override;
+};
+
+#endif // HWC_COMMON_PAPI_BACKEND_H
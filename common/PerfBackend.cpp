@@ -0,0 +1,396 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "PerfBackend.h"
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#define HW_CACHE(cache, op, result)                               \
+  (PERF_COUNT_HW_CACHE_##cache | (PERF_COUNT_HW_CACHE_OP_##op << 8) \
+   | (PERF_COUNT_HW_CACHE_RESULT_##result << 16))
+
+static const PerfBackend::Event events[] = {
+    // Hardware
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "Cycles"},
+    {"cpu-cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "Cycles"},
+    {"instructions",
+     PERF_TYPE_HARDWARE,
+     PERF_COUNT_HW_INSTRUCTIONS,
+     "Instructions"},
+    {"cache-references",
+     PERF_TYPE_HARDWARE,
+     PERF_COUNT_HW_CACHE_REFERENCES,
+     "Cache references"},
+    {"cache-misses",
+     PERF_TYPE_HARDWARE,
+     PERF_COUNT_HW_CACHE_MISSES,
+     "Cache misses"},
+    {"branches",
+     PERF_TYPE_HARDWARE,
+     PERF_COUNT_HW_BRANCH_INSTRUCTIONS,
+     "Branch instructions"},
+    {"branch-instructions",
+     PERF_TYPE_HARDWARE,
+     PERF_COUNT_HW_BRANCH_INSTRUCTIONS,
+     "Branch instructions"},
+    {"branch-misses",
+     PERF_TYPE_HARDWARE,
+     PERF_COUNT_HW_BRANCH_MISSES,
+     "Branch mispredictions"},
+    {"bus-cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BUS_CYCLES, "Bus cycles"},
+    {"stalled-cycles-frontend",
+     PERF_TYPE_HARDWARE,
+     PERF_COUNT_HW_STALLED_CYCLES_FRONTEND,
+     "Frontend stall cycles"},
+    {"stalled-cycles-backend",
+     PERF_TYPE_HARDWARE,
+     PERF_COUNT_HW_STALLED_CYCLES_BACKEND,
+     "Backend stall cycles"},
+    {"ref-cycles",
+     PERF_TYPE_HARDWARE,
+     PERF_COUNT_HW_REF_CPU_CYCLES,
+     "Reference cycles"},
+
+    // Software
+    {"cpu-clock",
+     PERF_TYPE_SOFTWARE,
+     PERF_COUNT_SW_CPU_CLOCK,
+     "CPU clock (ns)"},
+    {"task-clock",
+     PERF_TYPE_SOFTWARE,
+     PERF_COUNT_SW_TASK_CLOCK,
+     "Task clock (ns)"},
+    {"page-faults",
+     PERF_TYPE_SOFTWARE,
+     PERF_COUNT_SW_PAGE_FAULTS,
+     "Page faults"},
+    {"faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, "Page faults"},
+    {"minor-faults",
+     PERF_TYPE_SOFTWARE,
+     PERF_COUNT_SW_PAGE_FAULTS_MIN,
+     "Minor page faults"},
+    {"major-faults",
+     PERF_TYPE_SOFTWARE,
+     PERF_COUNT_SW_PAGE_FAULTS_MAJ,
+     "Major page faults"},
+    {"context-switches",
+     PERF_TYPE_SOFTWARE,
+     PERF_COUNT_SW_CONTEXT_SWITCHES,
+     "Context switches"},
+    {"cs",
+     PERF_TYPE_SOFTWARE,
+     PERF_COUNT_SW_CONTEXT_SWITCHES,
+     "Context switches"},
+    {"cpu-migrations",
+     PERF_TYPE_SOFTWARE,
+     PERF_COUNT_SW_CPU_MIGRATIONS,
+     "CPU migrations"},
+    {"migrations",
+     PERF_TYPE_SOFTWARE,
+     PERF_COUNT_SW_CPU_MIGRATIONS,
+     "CPU migrations"},
+    {"alignment-faults",
+     PERF_TYPE_SOFTWARE,
+     PERF_COUNT_SW_ALIGNMENT_FAULTS,
+     "Alignment faults"},
+    {"emulation-faults",
+     PERF_TYPE_SOFTWARE,
+     PERF_COUNT_SW_EMULATION_FAULTS,
+     "Emulation faults"},
+
+    // Caches
+    {"l1-dcache-loads",
+     PERF_TYPE_HW_CACHE,
+     HW_CACHE(L1D, READ, ACCESS),
+     "L1 data cache loads"},
+    {"l1-dcache-load-misses",
+     PERF_TYPE_HW_CACHE,
+     HW_CACHE(L1D, READ, MISS),
+     "L1 data cache load misses"},
+    {"l1-icache-load-misses",
+     PERF_TYPE_HW_CACHE,
+     HW_CACHE(L1I, READ, MISS),
+     "L1 instruction cache misses"},
+    {"llc-loads",
+     PERF_TYPE_HW_CACHE,
+     HW_CACHE(LL, READ, ACCESS),
+     "Last level cache loads"},
+    {"llc-load-misses",
+     PERF_TYPE_HW_CACHE,
+     HW_CACHE(LL, READ, MISS),
+     "Last level cache load misses"},
+    {"dtlb-load-misses",
+     PERF_TYPE_HW_CACHE,
+     HW_CACHE(DTLB, READ, MISS),
+     "Data TLB load misses"},
+    {"itlb-load-misses",
+     PERF_TYPE_HW_CACHE,
+     HW_CACHE(ITLB, READ, MISS),
+     "Instruction TLB misses"},
+};
+
+// The PAPI presets that have a direct equivalent
+static const std::pair<const char*, const char*> presets[] = {
+    {"PAPI_TOT_CYC", "cycles"},
+    {"PAPI_TOT_INS", "instructions"},
+    {"PAPI_REF_CYC", "ref-cycles"},
+    {"PAPI_BR_INS", "branch-instructions"},
+    {"PAPI_BR_MSP", "branch-misses"},
+    {"PAPI_L1_DCM", "l1-dcache-load-misses"},
+    {"PAPI_L1_ICM", "l1-icache-load-misses"},
+    {"PAPI_TLB_DM", "dtlb-load-misses"},
+    {"PAPI_TLB_IM", "itlb-load-misses"},
+};
+
+const PerfBackend::Event* PerfBackend::getEvent(const std::string& name) {
+  std::string key = hwc::normalizeCounterName(name);
+  for(const auto& preset : presets)
+    if(key == preset.first)
+      key = preset.second;
+
+  if(key.compare(0, 6, "perf::") == 0)
+    key = key.substr(6);
+  std::transform(key.begin(), key.end(), key.begin(), [](char c) {
+    return (c >= 'A' and c <= 'Z') ? c - 'A' + 'a' : c;
+  });
+
+  for(const Event& event : events)
+    if(key == event.name)
+      return &event;
+  return nullptr;
+}
+
+PerfBackend::PerfBackend(bool userRead) : userRead(userRead) {
+  ;
+}
+
+static inline uint64_t rdpmc(uint32_t counter) {
+#if defined(__x86_64__) || defined(__i386__)
+  uint32_t lo, hi;
+  asm volatile("rdpmc" : "=a"(lo), "=d"(hi) : "c"(counter));
+  return (static_cast<uint64_t>(hi) << 32) | lo;
+#else
+  (void)counter;
+  return 0;
+#endif
+}
+
+// Each counter is opened separately rather than as a group so that one
+// counter that cannot be scheduled does not prevent the others from being
+// recorded. The values are scaled if the kernel had to multiplex them
+class PerfSet : public CounterSet {
+protected:
+  struct Counter {
+    int fd;
+    // The page that the kernel keeps up to date with the state of the
+    // counter. This is null if it could not be mapped
+    volatile perf_event_mmap_page* page;
+  };
+
+  std::vector<Counter> counters;
+  bool userRead;
+  size_t pageSize;
+
+protected:
+  // Reads the counter with rdpmc following the protocol described in
+  // linux/perf_event.h. Returns false if the counter cannot be read from
+  // user space right now, for instance, because it is a software event, it
+  // is not currently scheduled on the PMU or it is being multiplexed
+  static bool readUser(volatile perf_event_mmap_page* page,
+                       CounterValue& value) {
+    uint32_t seq;
+    uint64_t count;
+    do {
+      seq = page->lock;
+      asm volatile("" ::: "memory");
+      uint32_t index = page->index;
+      if(not page->cap_user_rdpmc or not index
+         or page->time_enabled != page->time_running)
+        return false;
+      count = page->offset;
+      uint16_t width = page->pmc_width;
+      // The value is sign-extended from the width of the counter
+      int64_t pmc = static_cast<int64_t>(rdpmc(index - 1) << (64 - width))
+                    >> (64 - width);
+      count += pmc;
+      asm volatile("" ::: "memory");
+    } while(page->lock != seq);
+
+    value = count;
+    return true;
+  }
+
+  static CounterValue readOne(int fd) {
+    uint64_t buf[3] = {0, 0, 0};
+    if(::read(fd, buf, sizeof(buf)) != sizeof(buf))
+      return 0;
+    if(buf[2] and buf[2] < buf[1])
+      return static_cast<CounterValue>(static_cast<double>(buf[0]) * buf[1]
+                                       / buf[2]);
+    return buf[0];
+  }
+
+  CounterValue readOne(const Counter& counter) const {
+    CounterValue value;
+    if(counter.page and readUser(counter.page, value))
+      return value;
+    return readOne(counter.fd);
+  }
+
+public:
+  PerfSet(bool userRead)
+      : userRead(userRead), pageSize(sysconf(_SC_PAGESIZE)) {
+    ;
+  }
+
+  virtual ~PerfSet() {
+    for(const Counter& counter : counters) {
+      if(counter.page)
+        munmap(const_cast<perf_event_mmap_page*>(counter.page), pageSize);
+      close(counter.fd);
+    }
+  }
+
+  virtual bool add(const std::string& name) override {
+    const PerfBackend::Event* event = PerfBackend::getEvent(name);
+    if(not event)
+      return false;
+
+    struct perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = event->type;
+    attr.config = event->config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format
+        = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    int fd = syscall(
+        SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+    if(fd < 0)
+      return false;
+
+    // Software events are always read with read() so there is no point in
+    // mapping the page for them
+    volatile perf_event_mmap_page* page = nullptr;
+#if defined(__x86_64__) || defined(__i386__)
+    if(userRead and event->type != PERF_TYPE_SOFTWARE) {
+      void* addr = mmap(nullptr, pageSize, PROT_READ, MAP_SHARED, fd, 0);
+      if(addr != MAP_FAILED)
+        page = static_cast<volatile perf_event_mmap_page*>(addr);
+    }
+#endif
+    counters.push_back({fd, page});
+    return true;
+  }
+
+  virtual bool start() override {
+    for(const Counter& counter : counters) {
+      ioctl(counter.fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl(counter.fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    return true;
+  }
+
+  virtual void read(CounterValue* values) override {
+    for(size_t i = 0; i < counters.size(); i++)
+      values[i] = readOne(counters[i]);
+  }
+
+  // The counters are disabled first, so they will always be read with read()
+  virtual void stop(CounterValue* values) override {
+    for(size_t i = 0; i < counters.size(); i++) {
+      ioctl(counters[i].fd, PERF_EVENT_IOC_DISABLE, 0);
+      values[i] = readOne(counters[i].fd);
+    }
+  }
+};
+
+const char* PerfBackend::getName() const {
+  return "perf";
+}
+
+bool PerfBackend::isCounter(const std::string& name) const {
+  return getEvent(name);
+}
+
+std::string PerfBackend::getDescription(const std::string& name) const {
+  if(const Event* event = getEvent(name))
+    return event->descr;
+  return name;
+}
+
+std::unique_ptr<CounterSet> PerfBackend::createSet() const {
+  return std::unique_ptr<CounterSet>(new PerfSet(userRead));
+}
+
+// The sets never fail to add a counter because the kernel multiplexes them
+// when there are too many. Instead, the hardware events are opened as a
+// single pinned group. If the group cannot be put on the PMU all at once,
+// the kernel puts it in an error state and reading it returns nothing.
+// Software events are not counted by the PMU and never conflict
+bool PerfBackend::isCompatible(const std::vector<std::string>& counters) const {
+  std::vector<int> fds;
+  bool compatible = true;
+  for(const std::string& counter : counters) {
+    const Event* event = getEvent(counter);
+    if(not event) {
+      compatible = false;
+      break;
+    } else if(event->type == PERF_TYPE_SOFTWARE) {
+      continue;
+    }
+
+    struct perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = event->type;
+    attr.config = event->config;
+    attr.disabled = fds.empty();
+    attr.pinned = fds.empty();
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+
+    int leader = fds.empty() ? -1 : fds.front();
+    int fd = syscall(
+        SYS_perf_event_open, &attr, 0, -1, leader, PERF_FLAG_FD_CLOEXEC);
+    if(fd < 0) {
+      compatible = false;
+      break;
+    }
+    fds.push_back(fd);
+  }
+
+  if(compatible and fds.size()) {
+    std::vector<uint64_t> buf(fds.size() + 1);
+    ioctl(fds.front(), PERF_EVENT_IOC_ENABLE, 0);
+    compatible = ::read(fds.front(), buf.data(), buf.size() * sizeof(uint64_t))
+                 > 0;
+  }
+
+  for(int fd : fds)
+    close(fd);
+  return compatible;
+}
@@ -0,0 +1,60 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef HWC_COMMON_PERF_BACKEND_H
+#define HWC_COMMON_PERF_BACKEND_H
+
+#include "CounterBackend.h"
+
+#include <cstdint>
+
+// Records the counters using perf_event_open directly. This does not need
+// any libraries and works in containers and virtual machines where only the
+// software events are available. The counters use the names of the generic
+// events of perf, for instance, instructions, task-clock or page-faults,
+// optionally with a perf:: prefix. The most common PAPI presets are mapped
+// to the equivalent generic events.
+//
+// Where the kernel allows it, hardware counters are read from user space with
+// rdpmc using the page that perf maps for each event. This avoids a system
+// call for every read on the enter and exit paths. If the counter is not
+// currently on the PMU, or if rdpmc is not allowed, read() is used instead
+class PerfBackend : public CounterBackend {
+public:
+  struct Event {
+    const char* name;
+    uint32_t type;
+    uint64_t config;
+    const char* descr;
+  };
+
+protected:
+  bool userRead;
+
+public:
+  PerfBackend(bool userRead = true);
+  virtual ~PerfBackend() = default;
+
+  // Returns nullptr if there is no event with the name
+  static const Event* getEvent(const std::string& name);
+
+  virtual const char* getName() const override;
+  virtual bool isCounter(const std::string& name) const override;
+  virtual std::string getDescription(const std::string& name) const override;
+  virtual std::unique_ptr<CounterSet> createSet() const override;
+  virtual bool
+  isCompatible(const std::vector<std::string>& counters) const override;
+};
+
+#endif // HWC_COMMON_PERF_BACKEND_H
@@ -0,0 +1,523 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Profile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+Entry::Entry()
+    : kind(Kind::Function), id(0), start(0), end(0), occurs(0), time(0) {
+  ;
+}
+
+std::string Entry::getLabel() const {
+  if(kind == Kind::Function) {
+    if(qualified.length())
+      return qualified;
+    else if(name.length())
+      return name;
+  } else if(file.length()) {
+    return file + ":" + std::to_string(start) + "-" + std::to_string(end);
+  }
+  return std::to_string(id);
+}
+
+// The columns of the CSV output that are not counters
+enum class Column {
+  Kind,
+  ID,
+  Source,
+  Qualified,
+  File,
+  Start,
+  End,
+  Occurs,
+  Time,
+  Counter,
+};
+
+// Parses the lines in one part of a file. Only the formats that have one
+// function or region per line can be split up like this
+class Parser {
+protected:
+  std::vector<std::string>& names;
+  const std::vector<Column>& columns;
+  const char* p;
+  const char* end;
+
+protected:
+  void skipSpace() {
+    while(p < end and (*p == ' ' or *p == '\t' or *p == '\r'))
+      p++;
+  }
+
+  bool expect(char c) {
+    skipSpace();
+    if(p < end and *p == c) {
+      p++;
+      return true;
+    }
+    return false;
+  }
+
+  bool parseNumber(long long& val) {
+    skipSpace();
+    bool neg = (p < end and *p == '-');
+    if(neg)
+      p++;
+    if(p == end or *p < '0' or *p > '9')
+      return false;
+    unsigned long long u = 0;
+    while(p < end and *p >= '0' and *p <= '9')
+      u = u * 10 + (*p++ - '0');
+    val = neg ? -static_cast<long long>(u) : static_cast<long long>(u);
+    return true;
+  }
+
+  bool parseUnsigned(uint64_t& val) {
+    skipSpace();
+    if(p == end or *p < '0' or *p > '9')
+      return false;
+    val = 0;
+    while(p < end and *p >= '0' and *p <= '9')
+      val = val * 10 + (*p++ - '0');
+    return true;
+  }
+
+  bool parseString(std::string& s) {
+    if(not expect('"'))
+      return false;
+    s.clear();
+    while(p < end and *p != '"') {
+      if(*p == '\\') {
+        if(++p == end)
+          return false;
+        switch(*p) {
+        case 'n':
+          s += '\n';
+          break;
+        case 't':
+          s += '\t';
+          break;
+        case 'u':
+          // Only control characters are escaped like this by the runtime
+          if(end - p < 5)
+            return false;
+          s += static_cast<char>(std::strtol(std::string(p + 1, 4).c_str(),
+                                             nullptr,
+                                             16));
+          p += 4;
+          break;
+        default:
+          s += *p;
+          break;
+        }
+        p++;
+      } else {
+        s += *p++;
+      }
+    }
+    return expect('"');
+  }
+
+  // Values that are not understood are skipped so that fields can be added
+  // to the output without breaking older versions of this tool
+  bool skipValue() {
+    skipSpace();
+    if(p == end)
+      return false;
+    if(*p == '"') {
+      std::string s;
+      return parseString(s);
+    } else if(*p == '{' or *p == '[') {
+      char close = (*p == '{') ? '}' : ']';
+      p++;
+      skipSpace();
+      if(p < end and *p == close) {
+        p++;
+        return true;
+      }
+      do {
+        if(close == '}') {
+          std::string key;
+          if(not parseString(key) or not expect(':'))
+            return false;
+        }
+        if(not skipValue())
+          return false;
+      } while(expect(','));
+      return expect(close);
+    }
+    while(p < end and *p != ',' and *p != '}' and *p != ']')
+      p++;
+    return true;
+  }
+
+  unsigned intern(const std::string& name);
+
+  bool parseCounters(Entry& entry) {
+    if(not expect('{'))
+      return false;
+    if(expect('}'))
+      return true;
+    do {
+      std::string name;
+      long long val;
+      if(not parseString(name) or not expect(':') or not parseNumber(val))
+        return false;
+      entry.counters.emplace_back(intern(name), val);
+    } while(expect(','));
+    return expect('}');
+  }
+
+  bool parseJSON(Entry& entry) {
+    if(not expect('{'))
+      return false;
+    do {
+      std::string key, val;
+      if(not parseString(key) or not expect(':'))
+        return false;
+      bool ok = true;
+      if(key == "kind") {
+        ok = parseString(val);
+        entry.kind = (val == "region") ? Kind::Region : Kind::Function;
+      } else if(key == "id") {
+        skipSpace();
+        if(p < end and *p == '"')
+          ok = expect('"') and parseUnsigned(entry.id) and expect('"');
+        else
+          ok = parseUnsigned(entry.id);
+      } else if(key == "source") {
+        ok = parseString(entry.name);
+      } else if(key == "qualified") {
+        ok = parseString(entry.qualified);
+      } else if(key == "file") {
+        ok = parseString(entry.file);
+      } else if(key == "start" or key == "end") {
+        long long line = 0;
+        ok = parseNumber(line);
+        (key == "start" ? entry.start : entry.end) = line;
+      } else if(key == "occurs") {
+        ok = parseNumber(entry.occurs);
+      } else if(key == "time") {
+        ok = parseNumber(entry.time);
+      } else if(key == "counters") {
+        ok = parseCounters(entry);
+      } else if(key == "samples") {
+        // This is treated like any other counter
+        long long samples = 0;
+        ok = parseNumber(samples);
+        entry.counters.emplace_back(intern(key), samples);
+      } else {
+        ok = skipValue();
+      }
+      if(not ok)
+        return false;
+    } while(expect(','));
+    return expect('}');
+  }
+
+  bool parseField(std::string& s) {
+    s.clear();
+    if(p < end and *p == '"') {
+      p++;
+      while(p < end) {
+        if(*p == '"') {
+          if(p + 1 < end and p[1] == '"') {
+            s += '"';
+            p += 2;
+          } else {
+            p++;
+            break;
+          }
+        } else {
+          s += *p++;
+        }
+      }
+    } else {
+      while(p < end and *p != ',' and *p != '\r')
+        s += *p++;
+    }
+    return true;
+  }
+
+  bool parseCSV(Entry& entry) {
+    std::string field;
+    for(unsigned i = 0; i < columns.size(); i++) {
+      if(i and not expect(','))
+        return false;
+      parseField(field);
+      if(field.empty())
+        continue;
+
+      const char* s = field.c_str();
+      switch(columns[i]) {
+      case Column::Kind:
+        entry.kind = (field == "region") ? Kind::Region : Kind::Function;
+        break;
+      case Column::ID:
+        entry.id = std::strtoull(s, nullptr, 10);
+        break;
+      case Column::Source:
+        entry.name = field;
+        break;
+      case Column::Qualified:
+        entry.qualified = field;
+        break;
+      case Column::File:
+        entry.file = field;
+        break;
+      case Column::Start:
+        entry.start = std::strtoul(s, nullptr, 10);
+        break;
+      case Column::End:
+        entry.end = std::strtoul(s, nullptr, 10);
+        break;
+      case Column::Occurs:
+        entry.occurs = std::strtoll(s, nullptr, 10);
+        break;
+      case Column::Time:
+        entry.time = std::strtoll(s, nullptr, 10);
+        break;
+      case Column::Counter:
+        entry.counters.emplace_back(i, std::strtoll(s, nullptr, 10));
+        break;
+      }
+    }
+    return true;
+  }
+
+public:
+  Parser(std::vector<std::string>& names, const std::vector<Column>& columns)
+      : names(names), columns(columns), p(nullptr), end(nullptr) {
+    ;
+  }
+
+  // The index of the counters in the returned entry are those in names
+  bool parse(const char* begin, const char* end, Entry& entry) {
+    this->p = begin;
+    this->end = end;
+    entry = Entry();
+    if(columns.size())
+      return parseCSV(entry);
+    return parseJSON(entry);
+  }
+};
+
+unsigned Parser::intern(const std::string& name) {
+  for(unsigned i = 0; i < names.size(); i++)
+    if(names[i] == name)
+      return i;
+  names.push_back(name);
+  return names.size() - 1;
+}
+
+Profile::Profile(const std::string& file) : file(file) {
+  ;
+}
+
+const Entry* Profile::getEntry(const Key& key) const {
+  auto it = entries.find(key);
+  if(it == entries.end())
+    return nullptr;
+  return &it->second;
+}
+
+int Profile::getCounterID(const std::string& name) const {
+  auto it = counterIDs.find(name);
+  if(it == counterIDs.end())
+    return -1;
+  return it->second;
+}
+
+// The counters in the entry are indexed by their position in names
+void Profile::merge(Entry& entry, const std::vector<std::string>& names) {
+  for(auto& counter : entry.counters) {
+    const std::string& name = names.at(counter.first);
+    auto it = counterIDs.find(name);
+    if(it == counterIDs.end()) {
+      it = counterIDs.emplace(name, counterNames.size()).first;
+      counterNames.push_back(name);
+    }
+    counter.first = it->second;
+  }
+
+  Key key(entry.kind, entry.id);
+  auto it = entries.find(key);
+  if(it == entries.end()) {
+    entries.emplace(key, std::move(entry));
+    return;
+  }
+
+  Entry& curr = it->second;
+  curr.occurs += entry.occurs;
+  curr.time += entry.time;
+  for(const auto& counter : entry.counters) {
+    bool found = false;
+    for(auto& c : curr.counters) {
+      if(c.first == counter.first) {
+        c.second += counter.second;
+        found = true;
+        break;
+      }
+    }
+    if(not found)
+      curr.counters.push_back(counter);
+  }
+}
+
+void Profile::merge(Profile& other) {
+  for(auto& i : other.entries)
+    merge(i.second, other.counterNames);
+  other.entries.clear();
+}
+
+static bool isBlank(const char* begin, const char* end) {
+  for(const char* p = begin; p < end; p++)
+    if(*p != ' ' and *p != '\t' and *p != '\r')
+      return false;
+  return true;
+}
+
+bool Profile::read(unsigned threads) {
+  int fd = open(file.c_str(), O_RDONLY);
+  if(fd < 0) {
+    std::cerr << "hwc-report: Could not open " << file << "\n";
+    return false;
+  }
+
+  struct stat st;
+  fstat(fd, &st);
+  size_t size = st.st_size;
+  if(size == 0) {
+    close(fd);
+    return true;
+  }
+
+  void* mem = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(mem == MAP_FAILED) {
+    std::cerr << "hwc-report: Could not map " << file << "\n";
+    return false;
+  }
+  madvise(mem, size, MADV_SEQUENTIAL);
+
+  const char* begin = static_cast<const char*>(mem);
+  const char* end = begin + size;
+
+  // The header of a CSV file says which column contains what. The nested
+  // JSON output cannot be split into lines, so it is not accepted
+  std::vector<Column> columns;
+  std::vector<std::string> header;
+  const char* eol = static_cast<const char*>(std::memchr(begin, '\n', size));
+  const char* first = eol ? eol : end;
+  bool ok = true;
+  if(size >= 5 and std::strncmp(begin, "kind,", 5) == 0) {
+    std::string line(begin, first);
+    size_t pos = 0;
+    do {
+      size_t next = line.find(',', pos);
+      std::string col = line.substr(pos, next - pos);
+      if(col.length() and col.back() == '\r')
+        col.pop_back();
+      pos = (next == std::string::npos) ? next : next + 1;
+
+      static const std::map<std::string, Column> known = {
+          {"kind", Column::Kind},
+          {"id", Column::ID},
+          {"source", Column::Source},
+          {"qualified", Column::Qualified},
+          {"file", Column::File},
+          {"start", Column::Start},
+          {"end", Column::End},
+          {"occurs", Column::Occurs},
+          {"time", Column::Time},
+      };
+      auto it = known.find(col);
+      columns.push_back(it != known.end() ? it->second : Column::Counter);
+      header.push_back(col);
+    } while(pos != std::string::npos);
+    begin = eol ? eol + 1 : end;
+  } else if(isBlank(begin + 1, first) and *begin == '{') {
+    std::cerr << "hwc-report: " << file << " is in the nested JSON format. "
+              << "Set HWCINSTR_FORMAT to jsonl or csv when running\n";
+    ok = false;
+  }
+
+  // Split the file into roughly equal parts at line boundaries
+  std::vector<const char*> bounds = {begin};
+  for(unsigned i = 1; i < threads and ok; i++) {
+    const char* split = begin + (end - begin) * i / threads;
+    if(split <= bounds.back())
+      continue;
+    const char* nl = static_cast<const char*>(
+        std::memchr(split, '\n', end - split));
+    if(not nl)
+      break;
+    if(nl + 1 > bounds.back() and nl + 1 < end)
+      bounds.push_back(nl + 1);
+  }
+  bounds.push_back(end);
+
+  unsigned n = bounds.size() - 1;
+  std::vector<std::unique_ptr<Profile>> parts;
+  std::vector<std::vector<std::string>> names(n);
+  std::vector<char> failed(n, 0);
+  std::vector<std::thread> workers;
+  for(unsigned i = 0; i < n and ok; i++) {
+    parts.emplace_back(new Profile(file));
+    names[i] = header;
+    workers.emplace_back([&, i]() {
+      Parser parser(names[i], columns);
+      const char* p = bounds[i];
+      while(p < bounds[i + 1]) {
+        const char* nl = static_cast<const char*>(
+            std::memchr(p, '\n', bounds[i + 1] - p));
+        const char* eol = nl ? nl : bounds[i + 1];
+        if(not isBlank(p, eol)) {
+          Entry entry;
+          if(parser.parse(p, eol, entry)) {
+            parts[i]->merge(entry, names[i]);
+          } else if(not failed[i]) {
+            std::cerr << "hwc-report: " + file + ": Malformed line: "
+                             + std::string(p, std::min<size_t>(eol - p, 80))
+                             + "\n";
+            failed[i] = 1;
+          }
+        }
+        p = eol + 1;
+      }
+    });
+  }
+  for(std::thread& worker : workers)
+    worker.join();
+
+  for(unsigned i = 0; i < parts.size(); i++) {
+    ok &= not failed[i];
+    merge(*parts[i]);
+  }
+
+  munmap(mem, size);
+
+  return ok;
+}
@@ -0,0 +1,98 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef HWC_COMMON_PROFILE_H
+#define HWC_COMMON_PROFILE_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+enum class Kind {
+  Function,
+  Region,
+};
+
+// The statistics of one function or region as read from the output of an
+// instrumented run. The counters are indexed by the position of their name
+// in the profile that contains the entry
+struct Entry {
+  Kind kind;
+  uint64_t id;
+  std::string name;
+  std::string qualified;
+  std::string file;
+  unsigned start;
+  unsigned end;
+  long long occurs;
+  long long time;
+  std::vector<std::pair<unsigned, long long>> counters;
+
+  Entry();
+
+  // The most readable name available
+  std::string getLabel() const;
+};
+
+// The combined output of one run. If there are several entries with the same
+// kind and ID, for instance because the outputs of several processes were
+// concatenated, their statistics are added
+class Profile {
+public:
+  using Key = std::pair<Kind, uint64_t>;
+
+protected:
+  std::string file;
+  std::vector<std::string> counterNames;
+  std::map<std::string, unsigned> counterIDs;
+  std::map<Key, Entry> entries;
+
+protected:
+  void merge(Entry& entry, const std::vector<std::string>& names);
+  void merge(Profile& other);
+  bool readLines(const char* begin, const char* end);
+
+public:
+  Profile(const std::string& file);
+  Profile(const Profile&) = delete;
+  Profile(Profile&&) = default;
+
+  // The file is mapped into memory rather than read so memory usage depends
+  // only on the number of distinct functions and regions in it. The lines
+  // are parsed in parallel using the given number of threads. Returns false
+  // and prints an error if the file could not be parsed
+  bool read(unsigned threads);
+
+  const std::string& getFile() const {
+    return file;
+  }
+
+  const std::map<Key, Entry>& getEntries() const {
+    return entries;
+  }
+
+  const Entry* getEntry(const Key& key) const;
+
+  // The names of the counters indexed by the IDs used in the entries
+  const std::vector<std::string>& getCounterNames() const {
+    return counterNames;
+  }
+
+  // Returns -1 if the counter was not recorded for anything in the profile
+  int getCounterID(const std::string& name) const;
+};
+
+#endif // HWC_COMMON_PROFILE_H
@@ -18,14 +18,16 @@
 #define QUOTE_(s) #s
 #define QUOTE(s) QUOTE_(s)
 
-static const std::string symFuncMeta = QUOTE(HWC_GV_META_FUNC);
-static const std::string symNumFuncMeta = QUOTE(HWC_GV_NUM_META_FUNC);
-static const std::string symRegionMeta = QUOTE(HWC_GV_META_REGION);
-static const std::string symNumRegionMeta = QUOTE(HWC_GV_NUM_META_REGION);
+static const std::string symMeta = QUOTE(HWC_GV_META);
+static const std::string secFuncMeta = QUOTE(HWC_SEC_META_FUNC);
+static const std::string secRegionMeta = QUOTE(HWC_SEC_META_REGION);
+static const std::string secSleds = QUOTE(HWC_SEC_SLEDS);
 static const std::string funcEnterFunc = QUOTE(HWC_ENTER_FUNC);
 static const std::string funcExitFunc = QUOTE(HWC_EXIT_FUNC);
 static const std::string funcEnterRegion = QUOTE(HWC_ENTER_REGION);
 static const std::string funcExitRegion = QUOTE(HWC_EXIT_REGION);
+static const std::string funcRegisterModule = QUOTE(HWC_REGISTER_MODULE);
+static const std::string funcUnregisterModule = QUOTE(HWC_UNREGISTER_MODULE);
 
 namespace hwc {
 
@@ -45,20 +47,28 @@ const std::string& getFuncExitRegion() {
   return funcExitRegion;
 }
 
-const std::string& getSymFuncMeta() {
-  return symFuncMeta;
+const std::string& getFuncRegisterModule() {
+  return funcRegisterModule;
 }
 
-const std::string& getSymNumFuncMeta() {
-  return symNumFuncMeta;
+const std::string& getFuncUnregisterModule() {
+  return funcUnregisterModule;
 }
 
-const std::string& getSymRegionMeta() {
-  return symRegionMeta;
+const std::string& getSymMeta() {
+  return symMeta;
 }
 
-const std::string& getSymNumRegionMeta() {
-  return symNumRegionMeta;
+const std::string& getSecFuncMeta() {
+  return secFuncMeta;
+}
+
+const std::string& getSecRegionMeta() {
+  return secRegionMeta;
+}
+
+const std::string& getSecSleds() {
+  return secSleds;
 }
 
 } // namespace hwc
@@ -25,13 +25,18 @@ const std::string& getFuncEnterFunc();
 const std::string& getFuncExitFunc();
 const std::string& getFuncEnterRegion();
 const std::string& getFuncExitRegion();
+const std::string& getFuncRegisterModule();
+const std::string& getFuncUnregisterModule();
 
-// The function and region names and other metadata are saved as special
-// symbols in the library/executable.
-const std::string& getSymFuncMeta();
-const std::string& getSymNumFuncMeta();
-const std::string& getSymRegionMeta();
-const std::string& getSymNumRegionMeta();
+// The function and region names and other metadata are saved in special
+// sections in the library/executable. The bounds of the sections are saved
+// in a special symbol
+const std::string& getSymMeta();
+const std::string& getSecFuncMeta();
+const std::string& getSecRegionMeta();
+
+// The records of the patchable sleds are saved in this section
+const std::string& getSecSleds();
 
 } // namespace hwc
 
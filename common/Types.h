@@ -22,8 +22,8 @@
 using FunctionID = uint64_t;
 using RegionID = uint64_t;
 
-// These are used in PAPI's API
-using CounterID = int;
+// The counters are referred to by name. The values are as returned by the
+// counter backend
 using CounterValue = long long;
 
 using Time = long long;
@@ -36,7 +36,7 @@ namespace hwc {
 // to deal with in the frontend code
 struct RTFuncMeta {
   FunctionID id;
-  const CounterID* counters;
+  const char* const* counters;
   unsigned numCounters;
   const char* srcName;
   const char* qualName;
@@ -44,12 +44,12 @@ struct RTFuncMeta {
 
 struct FEFuncMeta {
   FunctionID id;
-  const std::vector<CounterID> counters;
+  const std::vector<std::string> counters;
   std::string srcName;
   std::string qualName;
 
   FEFuncMeta(FunctionID id,
-             const std::vector<CounterID>& counters,
+             const std::vector<std::string>& counters,
              const std::string& srcName,
              const std::string& qualName)
       : id(id), counters(counters), srcName(srcName), qualName(qualName) {
@@ -59,22 +59,54 @@ struct FEFuncMeta {
 
 struct RTRegionMeta {
   RegionID id;
-  const CounterID* counters;
+  const char* const* counters;
   unsigned numCounters;
   const char* file;
   unsigned startLine;
   unsigned endLine;
 };
 
+// A sequence of instructions at the entry or an exit of a function that does
+// nothing until it is patched by the runtime. The records are in a writable
+// section because the runtime saves the address of the trampoline that the
+// patched sled calls in them
+struct RTSled {
+  enum Kind : uint64_t {
+    Entry = 0,
+    Exit = 1,
+  };
+
+  // The number of bytes in the sled
+  static constexpr unsigned Size = 11;
+
+  uintptr_t address;
+  FunctionID id;
+  uint64_t kind;
+  void* trampoline;
+};
+
+// The bounds of the sections containing the metadata of all the functions
+// and regions in a single executable or shared object. The records in the
+// sections are laid out back-to-back like an array. The sleds are only
+// present if the functions were instrumented with them
+struct RTMeta {
+  const RTFuncMeta* funcsBegin;
+  const RTFuncMeta* funcsEnd;
+  const RTRegionMeta* regionsBegin;
+  const RTRegionMeta* regionsEnd;
+  RTSled* sledsBegin;
+  RTSled* sledsEnd;
+};
+
 struct FERegionMeta {
   RegionID id;
-  std::vector<CounterID> counters;
+  std::vector<std::string> counters;
   std::string file;
   unsigned startLine;
   unsigned endLine;
 
   FERegionMeta(RegionID id,
-               const std::vector<CounterID>& counters,
+               const std::vector<std::string>& counters,
                const std::string& file,
                unsigned startLine,
                unsigned endLine)
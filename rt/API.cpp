@@ -18,31 +18,125 @@
 #include "FunctionStats.h"
 #include "RTContext.h"
 #include "RegionStats.h"
+#include "hwcinstr.h"
+
+#ifdef HWC_HAVE_OMPT
+#include "OMPTool.h"
+#endif // HWC_HAVE_OMPT
+
+// The runtime may print warnings while it is being constructed. Including
+// this here ensures that the standard streams are initialized before it is
+#include <iostream>
 
 // Singleton global object that contains everything. It doesn't matter when
 // this gets initialized because all the data needed for the initialization
-// is saved in the object itself. The destructor will call the print method,
-// so it is guaranteed to run after everything is done.
+// is saved in the object itself. It is never destroyed because instrumented
+// code may run after it would have been, for instance, in the destructors
+// of other global objects or when shared objects are unloaded at exit. The
+// output is written when the runtime library itself is unloaded which is
+// after any shared objects that depend on it.
 //
-// FIXME: The only problem with this is that it is not thread-safe.
-static RTContext rt;
+// When the output has not been requested, everything below reduces to a
+// single branch.
+static RTContext& rt = *new RTContext;
+
+[[gnu::destructor]] static void finalize() {
+  rt.print();
+}
 
 extern "C" {
 
 [[gnu::used]] void HWC_ENTER_FUNC(FunctionID id) {
-  rt.getFunctionStats(id).start();
+  if(not rt.isActive())
+    return;
+
+  if(FunctionStats* stats = rt.getFunctionStats(id))
+    ThreadContext::get(rt).start(*stats);
 }
 
 [[gnu::used]] void HWC_EXIT_FUNC(FunctionID id) {
-  rt.getFunctionStats(id).stop();
+  if(not rt.isActive())
+    return;
+
+  if(FunctionStats* stats = rt.getFunctionStats(id))
+    ThreadContext::get(rt).stop(*stats);
 }
 
 [[gnu::used]] void HWC_ENTER_REGION(RegionID id) {
-  rt.getRegionStats(id).start();
+  if(not rt.isActive())
+    return;
+
+  if(RegionStats* stats = rt.getRegionStats(id))
+    ThreadContext::get(rt).start(*stats);
 }
 
 [[gnu::used]] void HWC_EXIT_REGION(RegionID id) {
-  rt.getRegionStats(id).stop();
+  if(not rt.isActive())
+    return;
+
+  if(RegionStats* stats = rt.getRegionStats(id))
+    ThreadContext::get(rt).stop(*stats);
+}
+
+[[gnu::used]] void HWC_REGISTER_MODULE(const hwc::RTMeta* meta) {
+  rt.registerModule(meta);
+}
+
+[[gnu::used]] void HWC_UNREGISTER_MODULE(const hwc::RTMeta* meta) {
+  rt.unregisterModule(meta);
+}
+
+[[gnu::used]] void hwcinstr_phase_begin(const char* name) {
+  if(not rt.isActive())
+    return;
+
+  rt.beginPhase(name ? name : "");
+  ThreadContext::get(rt).checkPartition();
+}
+
+[[gnu::used]] void hwcinstr_phase_end() {
+  if(not rt.isActive())
+    return;
+
+  rt.endPhase();
+  ThreadContext::get(rt).checkPartition();
+}
+
+[[gnu::used]] void hwcinstr_epoch_next() {
+  if(not rt.isActive())
+    return;
+
+  rt.nextEpoch();
+  ThreadContext::get(rt).checkPartition();
+}
+
+[[gnu::used]] int hwcinstr_patch(const char* functions) {
+  if(not rt.isActive())
+    return 0;
+
+  return rt.setPatched(functions ? functions : "*", true);
+}
+
+[[gnu::used]] int hwcinstr_unpatch(const char* functions) {
+  if(not rt.isActive())
+    return 0;
+
+  return rt.setPatched(functions ? functions : "*", false);
+}
+
+[[gnu::used]] void HWC_SLED_HANDLER(const hwc::RTSled* sled) {
+  if(sled->kind == hwc::RTSled::Entry)
+    HWC_ENTER_FUNC(sled->id);
+  else
+    HWC_EXIT_FUNC(sled->id);
+}
+
+#ifdef HWC_HAVE_OMPT
+// This is looked up by the OpenMP runtime when it is initialized
+[[gnu::used]] ompt_start_tool_result_t*
+ompt_start_tool(unsigned int, const char*) {
+  return OMPTool::start(rt);
 }
+#endif // HWC_HAVE_OMPT
 
 } // extern "C"
@@ -0,0 +1,254 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Replaces malloc, free and operator new and delete so that the allocations
+// made while a function or region is the innermost one on a thread can be
+// charged to it. This is built as a separate library that is linked before
+// the runtime or preloaded because it replaces the allocator for the whole
+// program. The calls are forwarded to the glibc allocator, so this cannot be
+// used together with another allocator that replaces malloc.
+//
+// Nothing is counted on threads that have never entered an instrumented
+// function or region, and nothing is timed unless the innermost function or
+// region records some allocation counter
+
+#include "ThreadContext.h"
+
+#include <malloc.h>
+
+#include <cerrno>
+#include <new>
+
+extern "C" {
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t num, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t align, size_t size);
+void* __libc_valloc(size_t size);
+void __libc_free(void* ptr);
+
+} // extern "C"
+
+// Returns nullptr if the allocation should not be counted because the
+// thread has no context or because the runtime itself is allocating
+static ThreadContext* getCounting() {
+  ThreadContext* tc = ThreadContext::getCurrent();
+  if(not tc or ThreadContext::isInternal())
+    return nullptr;
+  return tc;
+}
+
+template <typename Alloc>
+static void* allocate(size_t size, Alloc alloc) {
+  ThreadContext* tc = getCounting();
+  if(not tc)
+    return alloc();
+
+  RuntimeScope scope;
+  bool timed = tc->isCountingAllocs();
+  Time start = timed ? ThreadContext::tick() : 0;
+  void* ptr = alloc();
+  Time time = timed ? ThreadContext::tick() - start : 0;
+  if(ptr)
+    tc->addAlloc(size, malloc_usable_size(ptr), time);
+  return ptr;
+}
+
+static void release(void* ptr) {
+  if(not ptr)
+    return;
+
+  ThreadContext* tc = getCounting();
+  if(not tc)
+    return __libc_free(ptr);
+
+  RuntimeScope scope;
+  size_t usable = malloc_usable_size(ptr);
+  bool timed = tc->isCountingAllocs();
+  Time start = timed ? ThreadContext::tick() : 0;
+  __libc_free(ptr);
+  tc->addFree(usable, timed ? ThreadContext::tick() - start : 0);
+}
+
+static void* allocateNew(size_t size, size_t align) {
+  while(true) {
+    void* ptr = allocate(size, [size, align]() {
+      return align ? __libc_memalign(align, size) : __libc_malloc(size);
+    });
+    if(ptr)
+      return ptr;
+    std::new_handler handler = std::get_new_handler();
+    if(not handler)
+      throw std::bad_alloc();
+    handler();
+  }
+}
+
+static void* allocateNew(size_t size, size_t align, const std::nothrow_t&) {
+  try {
+    return allocateNew(size, align);
+  } catch(...) {
+    return nullptr;
+  }
+}
+
+extern "C" {
+
+void* malloc(size_t size) noexcept {
+  return allocate(size, [size]() { return __libc_malloc(size); });
+}
+
+void* calloc(size_t num, size_t size) noexcept {
+  return allocate(num * size,
+                  [num, size]() { return __libc_calloc(num, size); });
+}
+
+// A block that is resized counts as a new allocation and the old one as
+// freed. Nothing changes if the block could not be resized
+void* realloc(void* ptr, size_t size) noexcept {
+  if(not ptr)
+    return malloc(size);
+
+  ThreadContext* tc = getCounting();
+  if(not tc)
+    return __libc_realloc(ptr, size);
+
+  RuntimeScope scope;
+  size_t usable = malloc_usable_size(ptr);
+  bool timed = tc->isCountingAllocs();
+  Time start = timed ? ThreadContext::tick() : 0;
+  void* next = __libc_realloc(ptr, size);
+  Time time = timed ? ThreadContext::tick() - start : 0;
+  if(next or not size)
+    tc->addFree(usable, 0);
+  if(next)
+    tc->addAlloc(size, malloc_usable_size(next), time);
+  return next;
+}
+
+void free(void* ptr) noexcept {
+  release(ptr);
+}
+
+void* memalign(size_t align, size_t size) noexcept {
+  return allocate(size,
+                  [align, size]() { return __libc_memalign(align, size); });
+}
+
+void* aligned_alloc(size_t align, size_t size) noexcept {
+  return memalign(align, size);
+}
+
+void* valloc(size_t size) noexcept {
+  return allocate(size, [size]() { return __libc_valloc(size); });
+}
+
+int posix_memalign(void** ptr, size_t align, size_t size) noexcept {
+  if(not align or (align & (align - 1)) or align % sizeof(void*))
+    return EINVAL;
+  if(not(*ptr = memalign(align, size)))
+    return ENOMEM;
+  return 0;
+}
+
+} // extern "C"
+
+void* operator new(size_t size) {
+  return allocateNew(size, 0);
+}
+
+void* operator new[](size_t size) {
+  return allocateNew(size, 0);
+}
+
+void* operator new(size_t size, const std::nothrow_t& tag) noexcept {
+  return allocateNew(size, 0, tag);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept {
+  return allocateNew(size, 0, tag);
+}
+
+void* operator new(size_t size, std::align_val_t align) {
+  return allocateNew(size, static_cast<size_t>(align));
+}
+
+void* operator new[](size_t size, std::align_val_t align) {
+  return allocateNew(size, static_cast<size_t>(align));
+}
+
+void* operator new(size_t size,
+                   std::align_val_t align,
+                   const std::nothrow_t& tag) noexcept {
+  return allocateNew(size, static_cast<size_t>(align), tag);
+}
+
+void* operator new[](size_t size,
+                     std::align_val_t align,
+                     const std::nothrow_t& tag) noexcept {
+  return allocateNew(size, static_cast<size_t>(align), tag);
+}
+
+void operator delete(void* ptr) noexcept {
+  release(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+  release(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+  release(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+  release(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+  release(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+  release(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+  release(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+  release(ptr);
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept {
+  release(ptr);
+}
+
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept {
+  release(ptr);
+}
+
+void operator delete(void* ptr,
+                     std::align_val_t,
+                     const std::nothrow_t&) noexcept {
+  release(ptr);
+}
+
+void operator delete[](void* ptr,
+                       std::align_val_t,
+                       const std::nothrow_t&) noexcept {
+  release(ptr);
+}
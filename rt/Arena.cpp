@@ -0,0 +1,85 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Arena.h"
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cstdint>
+
+static const size_t hugePageSize = 2 * 1024 * 1024;
+static const size_t blockSize = 4 * hugePageSize;
+
+static size_t alignTo(size_t n, size_t alignment) {
+  return (n + alignment - 1) & ~(alignment - 1);
+}
+
+Arena::Arena() : hugePages(false), curr(nullptr), avail(0) {
+  ;
+}
+
+void Arena::setHugePages(bool hugePages) {
+  this->hugePages = hugePages;
+}
+
+char* Arena::map(size_t bytes) {
+  // Transparent huge pages are only used for aligned regions, so map more
+  // than is needed and trim the ends
+  size_t len = bytes + hugePageSize;
+  void* p = mmap(nullptr,
+                 len,
+                 PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS,
+                 -1,
+                 0);
+  if(p == MAP_FAILED)
+    return nullptr;
+
+  uintptr_t start = reinterpret_cast<uintptr_t>(p);
+  uintptr_t end = start + len;
+  uintptr_t alignedStart = alignTo(start, hugePageSize);
+  uintptr_t alignedEnd = alignedStart + bytes;
+  if(alignedStart > start)
+    munmap(p, alignedStart - start);
+  if(end > alignedEnd)
+    munmap(reinterpret_cast<void*>(alignedEnd), end - alignedEnd);
+
+  char* block = reinterpret_cast<char*>(alignedStart);
+  if(hugePages)
+    madvise(block, bytes, MADV_HUGEPAGE);
+
+  return block;
+}
+
+void* Arena::allocate(size_t bytes) {
+  bytes = alignTo(bytes, CacheLineSize);
+
+  std::lock_guard<std::mutex> guard(lock);
+
+  if(bytes > avail) {
+    size_t len = std::max(blockSize, alignTo(bytes, hugePageSize));
+    char* block = map(len);
+    if(not block)
+      return nullptr;
+    curr = block;
+    avail = len;
+  }
+
+  void* p = curr;
+  curr += bytes;
+  avail -= bytes;
+
+  return p;
+}
@@ -0,0 +1,49 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef HWC_ARENA_H
+#define HWC_ARENA_H
+
+#include <cstddef>
+#include <mutex>
+
+// Hands out zeroed, cache-line-aligned memory from large blocks that are
+// mapped directly. The blocks are aligned to huge page boundaries and may
+// optionally be backed by transparent huge pages to reduce the TLB misses
+// caused by the instrumentation. Nothing is ever freed
+class Arena {
+public:
+  static constexpr size_t CacheLineSize = 64;
+
+protected:
+  bool hugePages;
+  char* curr;
+  size_t avail;
+  std::mutex lock;
+
+protected:
+  char* map(size_t bytes);
+
+public:
+  Arena();
+  Arena(const Arena&) = delete;
+  Arena(Arena&&) = delete;
+
+  void setHugePages(bool hugePages);
+
+  // Returns nullptr if the memory could not be mapped
+  void* allocate(size_t bytes);
+};
+
+#endif // HWC_ARENA_H
@@ -0,0 +1,129 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Buffer.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstdio>
+
+static const char digitPairs[]
+    = "00010203040506070809"
+      "10111213141516171819"
+      "20212223242526272829"
+      "30313233343536373839"
+      "40414243444546474849"
+      "50515253545556575859"
+      "60616263646566676869"
+      "70717273747576777879"
+      "80818283848586878889"
+      "90919293949596979899";
+
+Buffer::Buffer(size_t capacity)
+    : data(new char[capacity]), size(0), capacity(capacity) {
+  ;
+}
+
+void Buffer::grow(size_t needed) {
+  while(capacity < needed)
+    capacity *= 2;
+  std::unique_ptr<char[]> next(new char[capacity]);
+  std::memcpy(next.get(), data.get(), size);
+  data.swap(next);
+}
+
+Buffer& Buffer::append(uint64_t val) {
+  // The digits are generated from the end of a temporary. The largest 64-bit
+  // integer has 20 digits
+  char tmp[20];
+  char* end = tmp + sizeof(tmp);
+  char* p = end;
+  while(val >= 100) {
+    unsigned i = (val % 100) * 2;
+    val /= 100;
+    p -= 2;
+    p[0] = digitPairs[i];
+    p[1] = digitPairs[i + 1];
+  }
+  if(val >= 10) {
+    unsigned i = val * 2;
+    p -= 2;
+    p[0] = digitPairs[i];
+    p[1] = digitPairs[i + 1];
+  } else {
+    *--p = '0' + val;
+  }
+
+  return append(p, end - p);
+}
+
+Buffer& Buffer::append(int64_t val) {
+  if(val < 0) {
+    append('-');
+    return append(~static_cast<uint64_t>(val) + 1);
+  }
+  return append(static_cast<uint64_t>(val));
+}
+
+Buffer& Buffer::append(double val) {
+  if(not std::isfinite(val))
+    return append('0');
+
+  char tmp[32];
+  int len = std::snprintf(tmp, sizeof(tmp), "%.6g", val);
+  return append(tmp, len);
+}
+
+static bool writeAll(int fd, const char* data, size_t size) {
+  while(size) {
+    ssize_t written = ::write(fd, data, size);
+    if(written < 0)
+      return false;
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+
+bool Buffer::write(const std::string& file) const {
+  if(file == "-")
+    return writeAll(STDOUT_FILENO, data.get(), size);
+
+  // Devices and pipes cannot be replaced, so they are written to directly
+  struct stat st;
+  if(stat(file.c_str(), &st) == 0 and not S_ISREG(st.st_mode)) {
+    int fd = open(file.c_str(), O_WRONLY);
+    if(fd < 0)
+      return false;
+    bool ok = writeAll(fd, data.get(), size);
+    return (close(fd) == 0) and ok;
+  }
+
+  std::string tmp = file + ".tmp." + std::to_string(getpid());
+  int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0)
+    return false;
+
+  bool ok = writeAll(fd, data.get(), size);
+  ok &= (close(fd) == 0);
+  if(ok)
+    ok = (std::rename(tmp.c_str(), file.c_str()) == 0);
+  if(not ok)
+    std::remove(tmp.c_str());
+
+  return ok;
+}
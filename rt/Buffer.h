@@ -0,0 +1,95 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef HWC_BUFFER_H
+#define HWC_BUFFER_H
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+
+// A single, large, growable buffer that the output is formatted into before
+// being written out in one go. Integers are formatted two digits at a time
+// without going through any of the standard library's stream machinery
+class Buffer {
+protected:
+  std::unique_ptr<char[]> data;
+  size_t size;
+  size_t capacity;
+
+protected:
+  void grow(size_t needed);
+
+  char* reserve(size_t bytes) {
+    if(size + bytes > capacity)
+      grow(size + bytes);
+    return &data[size];
+  }
+
+public:
+  Buffer(size_t capacity = 1 << 20);
+  Buffer(const Buffer&) = delete;
+  Buffer(Buffer&&) = delete;
+
+  Buffer& append(char c) {
+    *reserve(1) = c;
+    size += 1;
+    return *this;
+  }
+
+  Buffer& append(const char* s, size_t len) {
+    std::memcpy(reserve(len), s, len);
+    size += len;
+    return *this;
+  }
+
+  Buffer& append(const char* s) {
+    return append(s, std::strlen(s));
+  }
+
+  Buffer& append(const std::string& s) {
+    return append(s.data(), s.size());
+  }
+
+  Buffer& append(uint64_t val);
+  Buffer& append(int64_t val);
+
+  Buffer& append(unsigned val) {
+    return append(static_cast<uint64_t>(val));
+  }
+
+  Buffer& append(long long val) {
+    return append(static_cast<int64_t>(val));
+  }
+
+  // Only finite values are written with a few significant digits. Anything
+  // else is written as 0 so the output always remains valid JSON
+  Buffer& append(double val);
+
+  const char* getData() const {
+    return data.get();
+  }
+
+  size_t getSize() const {
+    return size;
+  }
+
+  // Returns false if the file could not be written. A file name of "-"
+  // writes to stdout. A regular file is written to a temporary file which is
+  // then renamed so a reader never sees it partially written
+  bool write(const std::string& file) const;
+};
+
+#endif // HWC_BUFFER_H
@@ -0,0 +1,185 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Control.h"
+#include "RTContext.h"
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+static const char* const help
+    = "ok enable PATTERN... | disable PATTERN... | "
+      "counters PATTERN = COUNTER,... | reset | pause | resume | "
+      "snapshot [FILE] | help\n";
+
+Control::Control(RTContext& rt) : rt(rt), fd(-1) {
+  ;
+}
+
+bool Control::start(const std::string& path) {
+  struct sockaddr_un addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if(path.length() >= sizeof(addr.sun_path))
+    return false;
+  std::strcpy(addr.sun_path, path.c_str());
+
+  // A socket that was left behind by an earlier run is replaced, but nothing
+  // else that is already there is ever removed
+  struct stat st;
+  if(lstat(path.c_str(), &st) == 0) {
+    if(not S_ISSOCK(st.st_mode) or ::unlink(path.c_str()) != 0)
+      return false;
+  } else if(errno != ENOENT) {
+    return false;
+  }
+
+  if((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+    return false;
+
+  // Only the owner of the process may connect
+  mode_t mask = umask(0077);
+  bool ok = bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr))
+            == 0;
+  umask(mask);
+  if(not ok or listen(fd, 4) != 0) {
+    close(fd);
+    fd = -1;
+    return false;
+  }
+
+  this->path = path;
+  std::thread(&Control::serve, this).detach();
+  return true;
+}
+
+void Control::stop() {
+  if(fd < 0)
+    return;
+
+  // Shutting the socket down wakes up the thread that is waiting on it
+  shutdown(fd, SHUT_RDWR);
+  ::unlink(path.c_str());
+  fd = -1;
+}
+
+void Control::serve() {
+  int sock = fd;
+  while(true) {
+    int conn = accept4(sock, nullptr, nullptr, SOCK_CLOEXEC);
+    if(conn >= 0) {
+      handle(conn);
+      close(conn);
+    } else if(errno != EINTR and errno != ECONNABORTED) {
+      break;
+    }
+  }
+  close(sock);
+}
+
+// The connection may have been closed by the client. This must not raise
+// SIGPIPE since that would kill the program
+static bool sendAll(int conn, const char* data, size_t size) {
+  while(size) {
+    ssize_t written = ::send(conn, data, size, MSG_NOSIGNAL);
+    if(written < 0)
+      return false;
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+
+static bool sendAll(int conn, const std::string& s) {
+  return sendAll(conn, s.data(), s.size());
+}
+
+void Control::handle(int conn) {
+  std::string pending;
+  char buf[4096];
+  ssize_t len;
+  while((len = recv(conn, buf, sizeof(buf), 0)) > 0) {
+    pending.append(buf, len);
+    size_t eol;
+    while((eol = pending.find('\n')) != std::string::npos) {
+      std::string line = pending.substr(0, eol);
+      pending.erase(0, eol + 1);
+      if(line.length() and line.back() == '\r')
+        line.pop_back();
+      if(line.find_first_not_of(" \t") == std::string::npos)
+        continue;
+      if(not sendAll(conn, execute(line, conn)))
+        return;
+    }
+  }
+}
+
+std::string Control::execute(const std::string& line, int conn) {
+  std::istringstream ss(line);
+  std::string cmd;
+  ss >> cmd;
+
+  std::string rules;
+  if(cmd == "enable" or cmd == "disable") {
+    std::string pattern;
+    while(ss >> pattern)
+      rules += (cmd == "enable" ? "+" : "-") + pattern + "\n";
+    if(rules.empty())
+      return "error: No patterns given\n";
+  } else if(cmd == "counters") {
+    std::getline(ss, rules);
+    if(rules.find('=') == std::string::npos)
+      return "error: Expected a pattern followed by = and the counters\n";
+  } else if(cmd == "reset") {
+    rt.reset();
+    return "ok\n";
+  } else if(cmd == "pause" or cmd == "stop") {
+    rt.pause();
+    return "ok\n";
+  } else if(cmd == "resume" or cmd == "start") {
+    rt.resume();
+    return "ok\n";
+  } else if(cmd == "snapshot") {
+    std::string file;
+    ss >> file;
+    Buffer buf;
+    rt.snapshot(buf);
+    if(file.length() and not buf.write(file))
+      return "error: Could not write to " + file + "\n";
+    else if(file.length())
+      return "ok\n";
+
+    // The reply gives the size of the output that follows it
+    if(sendAll(conn, "ok " + std::to_string(buf.getSize()) + "\n"))
+      sendAll(conn, buf.getData(), buf.getSize());
+    return "";
+  } else if(cmd == "help") {
+    return help;
+  } else {
+    return "error: Unknown command " + cmd + "\n";
+  }
+
+  int changed = rt.reconfigure(rules);
+  if(changed < 0)
+    return "error: Invalid pattern or counters\n";
+  return "ok " + std::to_string(changed) + "\n";
+}
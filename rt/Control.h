@@ -0,0 +1,63 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef HWC_CONTROL_H
+#define HWC_CONTROL_H
+
+#include <string>
+
+class RTContext;
+
+// Listens on a Unix domain socket for commands that change what is being
+// measured while the program is running. Each command is a single line and
+// gets a single line in reply that starts with "ok" or "error:". The output
+// of the snapshot command is written to the connection if no file is given.
+// Only one connection is served at a time
+//
+//   enable pattern ...              Measure the matching functions and regions
+//   disable pattern ...             Stop measuring them
+//   counters pattern = counter, ... Record these counters instead
+//   reset                           Discard everything recorded so far
+//   pause | stop                    Stop recording
+//   resume | start                  Start recording again
+//   snapshot [file]                 Write the output recorded so far
+//   help                            List the commands
+//
+// The patterns are the same as those of the overrides
+class Control {
+protected:
+  RTContext& rt;
+  std::string path;
+  int fd;
+
+protected:
+  void serve();
+  void handle(int conn);
+  std::string execute(const std::string& line, int conn);
+
+public:
+  Control(RTContext& rt);
+  Control(const Control&) = delete;
+  Control(Control&&) = delete;
+  ~Control() = default;
+
+  // Returns false if the socket could not be created. The commands are
+  // served from a separate thread
+  bool start(const std::string& path);
+
+  // Stops accepting connections and removes the socket
+  void stop();
+};
+
+#endif // HWC_CONTROL_H
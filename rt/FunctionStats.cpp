@@ -13,28 +13,23 @@
 // limitations under the License.
 
 #include "FunctionStats.h"
-#include "common/Formatting.h"
 
-FunctionStats::FunctionStats(RTContext& rt,
-                             const std::vector<CounterID>& counters,
+FunctionStats::FunctionStats(const std::vector<std::string>& counters,
+                             const std::vector<unsigned>& indices,
+                             Slot slot,
                              FunctionID id,
                              const std::string& srcName,
                              const std::string& qualName)
-    : Stats(rt, counters), id(id), srcName(srcName), qualName(qualName) {
+    : Stats(counters, indices, slot), id(id), srcName(srcName),
+      qualName(qualName) {
   ;
 }
 
-std::ostream& FunctionStats::print(std::ostream& os) const {
-  os << tab(2) << quote(id) << ": {\n";
-
-  if(srcName.length())
-    os << tab(3) << quote("Source") << ": " << quote(srcName) << ",\n";
-
-  if(qualName.size())
-    os << tab(3) << quote("Qualified") << ": " << quote(qualName) << ",\n";
-
-  Stats::print(os) << "\n";
-  os << tab(2) << "}";
-
-  return os;
+FunctionStats::FunctionStats(const FunctionStats& stats,
+                             const std::vector<std::string>& counters,
+                             const std::vector<unsigned>& indices,
+                             Slot slot)
+    : Stats(counters, indices, slot), id(stats.id), srcName(stats.srcName),
+      qualName(stats.qualName) {
+  ;
 }
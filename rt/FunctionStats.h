@@ -17,8 +17,6 @@
 
 #include "Stats.h"
 
-class RTContext;
-
 class FunctionStats : public Stats {
 protected:
   FunctionID id;
@@ -26,16 +24,33 @@ protected:
   std::string qualName;
 
 public:
-  FunctionStats(RTContext& rt,
-                const std::vector<CounterID>& counters,
+  FunctionStats(const std::vector<std::string>& counters,
+                const std::vector<unsigned>& indices,
+                Slot slot,
                 FunctionID id,
                 const std::string& srcName,
                 const std::string& qualName);
+
+  // The same function recording different counters
+  FunctionStats(const FunctionStats& stats,
+                const std::vector<std::string>& counters,
+                const std::vector<unsigned>& indices,
+                Slot slot);
   FunctionStats(const FunctionStats&) = delete;
   FunctionStats(FunctionStats&&) = delete;
   virtual ~FunctionStats() = default;
 
-  virtual std::ostream& print(std::ostream& os) const override;
+  FunctionID getID() const {
+    return id;
+  }
+
+  const std::string& getSourceName() const {
+    return srcName;
+  }
+
+  const std::string& getQualifiedName() const {
+    return qualName;
+  }
 };
 
 #endif // HWC_FUNCTION_STATS_H
@@ -0,0 +1,232 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "OMPTool.h"
+#include "RTContext.h"
+
+#include <algorithm>
+#include <memory>
+
+static RTContext* rt = nullptr;
+
+namespace {
+
+// A parallel region that was started from within an instrumented function or
+// region. It is shared by the threads in the team and is deleted when the
+// region ends
+struct Team {
+  // Each thread only writes to its own member
+  struct Member {
+    // When the thread started working on the region
+    Time begin;
+
+    // When the thread last arrived at a barrier. After the region has ended,
+    // this is when it arrived at the barrier at the end of the region
+    Time arrive;
+
+    // The time spent waiting in barriers before the last arrival
+    Time waited;
+  };
+
+  const Stats* stats;
+  unsigned size;
+  std::unique_ptr<Member[]> members;
+
+  Team(const Stats* stats, unsigned size)
+      : stats(stats), size(size), members(new Member[size]()) {
+    ;
+  }
+};
+
+// The part of a parallel region executed by a single thread. The OpenMP
+// runtime may end the implicit tasks of the worker threads some time after
+// the region has ended, so nothing in here refers to the team after that
+struct Task {
+  Team* team;
+  unsigned index;
+  const Stats* stats;
+
+  // True if the work done by this thread is currently being attributed to the
+  // stats. This is never the case for the thread that started the region
+  // because it is already in the function
+  bool attached;
+
+  Time waitBegin;
+  Time waited;
+};
+
+} // namespace
+
+static void onThreadBegin(ompt_thread_t type, ompt_data_t*) {
+  if(type == ompt_thread_worker)
+    ThreadContext::get(*rt).prime();
+}
+
+static void onThreadEnd(ompt_data_t*) {
+  ThreadContext::get(*rt).finish();
+}
+
+static void onParallelBegin(ompt_data_t* encounteringTask,
+                            const ompt_frame_t*,
+                            ompt_data_t* parallel,
+                            unsigned requested,
+                            int,
+                            const void*) {
+  // A parallel region started from within the outlined body of another gets
+  // attributed to the same function as the outer one
+  const Stats* stats = ThreadContext::get(*rt).getEnclosing();
+  if(not stats and encounteringTask)
+    if(const Task* task = static_cast<const Task*>(encounteringTask->ptr))
+      stats = task->stats;
+
+  parallel->ptr = stats ? new Team(stats, requested) : nullptr;
+}
+
+static void onParallelEnd(ompt_data_t* parallel, ompt_data_t*, int,
+                          const void*) {
+  Team* team = static_cast<Team*>(parallel->ptr);
+  if(not team)
+    return;
+
+  // All the threads have arrived at the barrier at the end of the region by
+  // the time this is called
+  Time join = ThreadContext::tick();
+  Time maxWork = 0;
+  Time sumWork = 0;
+  Time wait = 0;
+  unsigned n = 0;
+  for(unsigned i = 0; i < team->size; i++) {
+    const Team::Member& member = team->members[i];
+    if(not member.begin)
+      continue;
+    Time arrive = member.arrive ? member.arrive : join;
+    Time work = arrive - member.begin - member.waited;
+    maxWork = std::max(maxWork, work);
+    sumWork += work;
+    wait += member.waited + join - arrive;
+    n += 1;
+  }
+  if(n)
+    rt->addParallel(*team->stats, maxWork - sumWork / n, wait);
+
+  delete team;
+  parallel->ptr = nullptr;
+}
+
+static void onImplicitTask(ompt_scope_endpoint_t endpoint,
+                           ompt_data_t* parallel,
+                           ompt_data_t* taskData,
+                           unsigned,
+                           unsigned index,
+                           int flags) {
+  if(flags & ompt_task_initial)
+    return;
+
+  if(endpoint == ompt_scope_begin) {
+    Team* team = parallel ? static_cast<Team*>(parallel->ptr) : nullptr;
+    if(not team) {
+      taskData->ptr = nullptr;
+      return;
+    }
+
+    Task* task = new Task{team, index, team->stats, false, 0, 0};
+    taskData->ptr = task;
+    if(index < team->size)
+      team->members[index].begin = ThreadContext::tick();
+    if(index) {
+      ThreadContext::get(*rt).attach(*task->stats);
+      task->attached = true;
+    }
+  } else {
+    Task* task = static_cast<Task*>(taskData->ptr);
+    if(not task)
+      return;
+
+    if(task->attached)
+      ThreadContext::get(*rt).detach();
+    delete task;
+    taskData->ptr = nullptr;
+  }
+}
+
+// The time spent waiting in a barrier is not attributed to the function.
+// Waiting in the other synchronization constructs is treated as work
+static void onSyncRegionWait(ompt_sync_region_t kind,
+                             ompt_scope_endpoint_t endpoint,
+                             ompt_data_t*,
+                             ompt_data_t* taskData,
+                             const void*) {
+  if(kind == ompt_sync_region_taskwait or kind == ompt_sync_region_taskgroup
+     or kind == ompt_sync_region_reduction)
+    return;
+
+  Task* task = taskData ? static_cast<Task*>(taskData->ptr) : nullptr;
+  if(not task)
+    return;
+
+  Time now = ThreadContext::tick();
+  if(endpoint == ompt_scope_begin) {
+    if(task->attached) {
+      ThreadContext::get(*rt).detach();
+      task->attached = false;
+    }
+    task->waitBegin = now;
+    if(task->index < task->team->size) {
+      Team::Member& member = task->team->members[task->index];
+      member.arrive = now;
+      member.waited = task->waited;
+    }
+  } else {
+    task->waited += now - task->waitBegin;
+    if(task->index and not task->attached) {
+      ThreadContext::get(*rt).attach(*task->stats);
+      task->attached = true;
+    }
+  }
+}
+
+static int initialize(ompt_function_lookup_t lookup, int, ompt_data_t*) {
+  auto setCallback
+      = reinterpret_cast<ompt_set_callback_t>(lookup("ompt_set_callback"));
+  if(not setCallback)
+    return 0;
+
+  setCallback(ompt_callback_thread_begin,
+              reinterpret_cast<ompt_callback_t>(onThreadBegin));
+  setCallback(ompt_callback_thread_end,
+              reinterpret_cast<ompt_callback_t>(onThreadEnd));
+  setCallback(ompt_callback_parallel_begin,
+              reinterpret_cast<ompt_callback_t>(onParallelBegin));
+  setCallback(ompt_callback_parallel_end,
+              reinterpret_cast<ompt_callback_t>(onParallelEnd));
+  setCallback(ompt_callback_implicit_task,
+              reinterpret_cast<ompt_callback_t>(onImplicitTask));
+  setCallback(ompt_callback_sync_region_wait,
+              reinterpret_cast<ompt_callback_t>(onSyncRegionWait));
+
+  return 1;
+}
+
+static void finalize(ompt_data_t*) {
+  ;
+}
+
+ompt_start_tool_result_t* OMPTool::start(RTContext& ctx) {
+  if(not ctx.isActive())
+    return nullptr;
+
+  rt = &ctx;
+  static ompt_start_tool_result_t result = {initialize, finalize, {0}};
+  return &result;
+}
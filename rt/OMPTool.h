@@ -0,0 +1,33 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef HWC_OMP_TOOL_H
+#define HWC_OMP_TOOL_H
+
+#include <omp-tools.h>
+
+class RTContext;
+
+// Registers the runtime as an OpenMP tool. The work done by the threads of a
+// parallel region is attributed to the function or region that the region
+// was started from. Without this, only the thread that encountered the
+// parallel region would be measured. The imbalance between the threads of
+// each team and the time that they spend waiting in barriers is recorded as
+// well. The tool is only registered when the output has been requested
+class OMPTool {
+public:
+  static ompt_start_tool_result_t* start(RTContext& rt);
+};
+
+#endif // HWC_OMP_TOOL_H
@@ -0,0 +1,673 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Output.h"
+
+#include <algorithm>
+#include <cmath>
+
+static const char hexDigits[] = "0123456789abcdef";
+
+static bool endsWith(const std::string& s, const std::string& suffix) {
+  return s.size() >= suffix.size()
+         and s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+Output::Format Output::getFormat(const std::string& name,
+                                 const std::string& file) {
+  if(name == "csv")
+    return Format::CSV;
+  else if(name == "jsonl")
+    return Format::JSONLines;
+  else if(name == "prom" or name == "prometheus")
+    return Format::Prometheus;
+  else if(name.length())
+    return Format::JSON;
+
+  if(endsWith(file, ".csv"))
+    return Format::CSV;
+  else if(endsWith(file, ".jsonl"))
+    return Format::JSONLines;
+  else if(endsWith(file, ".prom"))
+    return Format::Prometheus;
+  return Format::JSON;
+}
+
+std::unique_ptr<Output> Output::create(Format format) {
+  switch(format) {
+  case Format::CSV:
+    return std::unique_ptr<Output>(new CSVOutput());
+  case Format::JSONLines:
+    return std::unique_ptr<Output>(new JSONLinesOutput());
+  case Format::Prometheus:
+    return std::unique_ptr<Output>(new PrometheusOutput());
+  default:
+    return std::unique_ptr<Output>(new JSONOutput());
+  }
+}
+
+static void appendJSON(Buffer& buf, const std::string& s) {
+  buf.append('"');
+  for(char c : s) {
+    if(c == '"' or c == '\\') {
+      buf.append('\\').append(c);
+    } else if(c == '\n') {
+      buf.append("\\n", 2);
+    } else if(static_cast<unsigned char>(c) < 0x20) {
+      buf.append("\\u00", 4);
+      buf.append(hexDigits[c >> 4]).append(hexDigits[c & 0xf]);
+    } else {
+      buf.append(c);
+    }
+  }
+  buf.append('"');
+}
+
+// Fields are only quoted when they need to be (RFC 4180)
+static void appendCSV(Buffer& buf, const std::string& s) {
+  if(s.find_first_of(",\"\r\n") == std::string::npos) {
+    buf.append(s);
+    return;
+  }
+
+  buf.append('"');
+  for(char c : s) {
+    if(c == '"')
+      buf.append('"');
+    buf.append(c);
+  }
+  buf.append('"');
+}
+
+static void appendLabel(Buffer& buf, const std::string& s) {
+  buf.append('"');
+  for(char c : s) {
+    if(c == '"' or c == '\\')
+      buf.append('\\').append(c);
+    else if(c == '\n')
+      buf.append("\\n", 2);
+    else
+      buf.append(c);
+  }
+  buf.append('"');
+}
+
+static void
+appendLocation(Buffer& buf, const std::string& file, unsigned line) {
+  appendJSON(buf, file + ":" + std::to_string(line));
+}
+
+// The values of the counters recorded for some stats, indexed by their
+// position in the per-thread counter set. Counters that were not recorded
+// are null
+template <typename StatsType>
+static void getRow(const Report::Entry<StatsType>& entry,
+                   std::vector<const CounterValue*>& row) {
+  std::fill(row.begin(), row.end(), nullptr);
+  const unsigned* indices = entry.stats->getIndices();
+  for(unsigned i = 0; i < entry.stats->getNumCounters(); i++)
+    if(indices[i] < row.size())
+      row[indices[i]] = &entry.totals.counters[i];
+}
+
+// How unevenly the time, or the samples in sampling mode, were spread over
+// the threads that recorded anything for a function or region. This is only
+// meaningful if there were at least two of them
+static void getImbalance(const Totals& totals,
+                         const Report& report,
+                         double& maxMean,
+                         double& cv) {
+  bool sampling = report.sampleEvent.length();
+  double n = totals.threads.size();
+  double mean = (sampling ? totals.samples : totals.time) / n;
+  double max = 0;
+  double var = 0;
+  for(const ThreadTotals& thread : totals.threads) {
+    double val = sampling ? thread.samples : thread.time;
+    max = std::max(max, val);
+    var += (val - mean) * (val - mean);
+  }
+  maxMean = max / mean;
+  cv = std::sqrt(var / n) / mean;
+}
+
+// JSON
+
+static void appendJSONCounters(Buffer& buf,
+                               const Stats& stats,
+                               const std::vector<CounterValue>& values,
+                               const Report& report,
+                               const char* sep) {
+  const unsigned* indices = stats.getIndices();
+  for(unsigned i = 0; i < stats.getNumCounters(); i++) {
+    buf.append(sep);
+    if(indices[i] < report.counterDescrs.size())
+      appendJSON(buf, report.counterDescrs[indices[i]]);
+    else
+      appendJSON(buf, stats.getCounters()[i]);
+    buf.append(": ").append(values[i]);
+  }
+}
+
+// The totals of a single thread, phase or epoch written on one line
+template <typename TotalsType>
+static void appendJSONInline(Buffer& buf,
+                             const Stats& stats,
+                             const TotalsType& totals,
+                             const Report& report) {
+  buf.append("{\"Occurs\": ").append(totals.occurs);
+  if(report.sampleEvent.length())
+    buf.append(", \"Samples\": ").append(totals.samples);
+  else
+    buf.append(", \"Time\": ").append(totals.time);
+  appendJSONCounters(buf, stats, totals.counters, report, ", ");
+  buf.append('}');
+}
+
+template <typename StatsType>
+static void writeJSONPartitions(Buffer& buf,
+                                const Report::Entry<StatsType>& entry,
+                                const Report& report) {
+  if(entry.phases.size()) {
+    buf.append(",\n      \"Phases\": {");
+    bool comma = false;
+    for(const auto& phase : entry.phases) {
+      buf.append(comma ? ",\n" : "\n");
+      buf.append("        ");
+      appendJSON(buf, phase.first);
+      buf.append(": ");
+      appendJSONInline(buf, *entry.stats, phase.second, report);
+      comma = true;
+    }
+    buf.append("\n      }");
+  }
+
+  if(entry.epochs.size()) {
+    buf.append(",\n      \"Epochs\": {");
+    bool comma = false;
+    for(const auto& epoch : entry.epochs) {
+      buf.append(comma ? ",\n" : "\n");
+      buf.append("        \"").append(epoch.first).append("\": ");
+      appendJSONInline(buf, *entry.stats, epoch.second, report);
+      comma = true;
+    }
+    buf.append("\n      }");
+  }
+}
+
+template <typename StatsType>
+static void writeJSONThreads(Buffer& buf,
+                             const Report::Entry<StatsType>& entry,
+                             const Report& report) {
+  buf.append(",\n      \"Threads\": {");
+  bool comma = false;
+  for(const ThreadTotals& thread : entry.totals.threads) {
+    buf.append(comma ? ",\n" : "\n");
+    buf.append("        \"").append(thread.thread).append("\": ");
+    appendJSONInline(buf, *entry.stats, thread, report);
+    comma = true;
+  }
+  buf.append(comma ? "\n      }" : "}");
+
+  if(entry.totals.threads.size() > 1) {
+    const char* what = report.sampleEvent.length() ? "Samples" : "Time";
+    double maxMean, cv;
+    getImbalance(entry.totals, report, maxMean, cv);
+    buf.append(",\n      \"").append(what).append(" max/mean\": ");
+    buf.append(maxMean);
+    buf.append(",\n      \"").append(what).append(" CV\": ").append(cv);
+  }
+}
+
+template <typename StatsType>
+static void writeJSONCommon(Buffer& buf,
+                            const Report::Entry<StatsType>& entry,
+                            const Report& report) {
+  buf.append("      \"Occurs\": ").append(entry.totals.occurs);
+  if(report.sampleEvent.length())
+    buf.append(",\n      \"Samples\": ").append(entry.totals.samples);
+  else
+    buf.append(",\n      \"Time\": ").append(entry.totals.time);
+  appendJSONCounters(
+      buf, *entry.stats, entry.totals.counters, report, ",\n      ");
+
+  const ParallelTotals& parallel = entry.totals.parallel;
+  if(parallel.teams) {
+    buf.append(",\n      \"OMP teams\": ").append(parallel.teams);
+    buf.append(",\n      \"OMP imbalance\": ").append(parallel.imbalance);
+    buf.append(",\n      \"OMP barrier wait\": ")
+        .append(parallel.barrierWait);
+  }
+
+  writeJSONPartitions(buf, entry, report);
+  if(report.threads.size() > 1)
+    writeJSONThreads(buf, entry, report);
+  buf.append("\n    }");
+}
+
+static void writeJSON(Buffer& buf,
+                      const Report::Entry<FunctionStats>& entry,
+                      const Report& report) {
+  const FunctionStats& stats = *entry.stats;
+
+  buf.append("    \"").append(stats.getID()).append("\": {\n");
+  if(stats.getSourceName().length()) {
+    buf.append("      \"Source\": ");
+    appendJSON(buf, stats.getSourceName());
+    buf.append(",\n");
+  }
+  if(stats.getQualifiedName().length()) {
+    buf.append("      \"Qualified\": ");
+    appendJSON(buf, stats.getQualifiedName());
+    buf.append(",\n");
+  }
+  writeJSONCommon(buf, entry, report);
+}
+
+static void writeJSON(Buffer& buf,
+                      const Report::Entry<RegionStats>& entry,
+                      const Report& report) {
+  const RegionStats& stats = *entry.stats;
+
+  buf.append("    \"").append(stats.getID()).append("\": {\n");
+  if(stats.getFile().length()) {
+    if(stats.getStartLine()) {
+      buf.append("      \"Start\": ");
+      appendLocation(buf, stats.getFile(), stats.getStartLine());
+      buf.append(",\n");
+    }
+    if(stats.getEndLine()) {
+      buf.append("      \"End\": ");
+      appendLocation(buf, stats.getFile(), stats.getEndLine());
+      buf.append(",\n");
+    }
+  }
+  writeJSONCommon(buf, entry, report);
+}
+
+template <typename StatsType>
+static void writeJSON(Buffer& buf,
+                      const char* key,
+                      const std::vector<Report::Entry<StatsType>>& entries,
+                      const Report& report) {
+  buf.append("  \"").append(key).append("\": {");
+  bool comma = false;
+  for(const Report::Entry<StatsType>& entry : entries) {
+    buf.append(comma ? ",\n" : "\n");
+    writeJSON(buf, entry, report);
+    comma = true;
+  }
+  buf.append(comma ? "\n  }" : "}");
+}
+
+void JSONOutput::write(Buffer& buf, const Report& report) const {
+  buf.append("{\n");
+  writeJSON(buf, "functions", report.funcs, report);
+  buf.append(",\n");
+  writeJSON(buf, "regions", report.regions, report);
+
+  if(report.threads.size() > 1) {
+    buf.append(",\n  \"threads\": {");
+    for(unsigned i = 0; i < report.threads.size(); i++) {
+      buf.append(i ? ",\n" : "\n");
+      buf.append("    \"").append(i).append("\": {\"TID\": ");
+      buf.append(static_cast<int64_t>(report.threads[i].tid));
+      buf.append(", \"Name\": ");
+      appendJSON(buf, report.threads[i].name);
+      buf.append('}');
+    }
+    buf.append("\n  }");
+  }
+
+  if(report.sampleEvent.length()) {
+    buf.append(",\n  \"sampling\": {\"Event\": ");
+    appendJSON(buf, report.sampleEvent);
+    buf.append(", \"Period\": ").append(report.samplePeriod);
+    buf.append(", \"Unattributed\": ").append(report.unattributed);
+    buf.append('}');
+  }
+  buf.append("\n}\n");
+}
+
+// CSV
+
+template <typename StatsType>
+static void writeCSVCommon(Buffer& buf,
+                           const Report::Entry<StatsType>& entry,
+                           const Report& report,
+                           std::vector<const CounterValue*>& row) {
+  buf.append(',').append(entry.totals.occurs);
+  buf.append(',').append(entry.totals.time);
+  if(report.sampleEvent.length())
+    buf.append(',').append(entry.totals.samples);
+
+  getRow(entry, row);
+  for(const CounterValue* value : row) {
+    buf.append(',');
+    if(value)
+      buf.append(*value);
+  }
+
+  const ParallelTotals& parallel = entry.totals.parallel;
+  if(report.parallel and parallel.teams) {
+    buf.append(',').append(parallel.teams);
+    buf.append(',').append(parallel.imbalance);
+    buf.append(',').append(parallel.barrierWait);
+  } else if(report.parallel) {
+    buf.append(",,,");
+  }
+  buf.append('\n');
+}
+
+void CSVOutput::write(Buffer& buf, const Report& report) const {
+  buf.append("kind,id,source,qualified,file,start,end,occurs,time");
+  if(report.sampleEvent.length())
+    buf.append(",samples");
+  for(const std::string& name : report.counterNames) {
+    buf.append(',');
+    appendCSV(buf, name);
+  }
+  if(report.parallel)
+    buf.append(",omp_teams,omp_imbalance,omp_barrier_wait");
+  buf.append('\n');
+
+  std::vector<const CounterValue*> row(report.counterNames.size());
+  for(const Report::Entry<FunctionStats>& entry : report.funcs) {
+    const FunctionStats& stats = *entry.stats;
+    buf.append("function,").append(stats.getID()).append(',');
+    appendCSV(buf, stats.getSourceName());
+    buf.append(',');
+    appendCSV(buf, stats.getQualifiedName());
+    buf.append(",,,");
+    writeCSVCommon(buf, entry, report, row);
+  }
+
+  for(const Report::Entry<RegionStats>& entry : report.regions) {
+    const RegionStats& stats = *entry.stats;
+    buf.append("region,").append(stats.getID()).append(",,,");
+    appendCSV(buf, stats.getFile());
+    buf.append(',');
+    if(stats.getStartLine())
+      buf.append(stats.getStartLine());
+    buf.append(',');
+    if(stats.getEndLine())
+      buf.append(stats.getEndLine());
+    writeCSVCommon(buf, entry, report, row);
+  }
+}
+
+// JSON Lines
+
+static void appendJSONLinesCounters(Buffer& buf,
+                                    const Stats& stats,
+                                    const std::vector<CounterValue>& values,
+                                    const Report& report) {
+  buf.append(",\"counters\":{");
+  const unsigned* indices = stats.getIndices();
+  for(unsigned i = 0; i < stats.getNumCounters(); i++) {
+    if(i)
+      buf.append(',');
+    if(indices[i] < report.counterNames.size())
+      appendJSON(buf, report.counterNames[indices[i]]);
+    else
+      appendJSON(buf, stats.getCounters()[i]);
+    buf.append(':').append(values[i]);
+  }
+  buf.append('}');
+}
+
+// The values in a phase or epoch
+static void appendJSONLinesTotals(Buffer& buf,
+                                  const Stats& stats,
+                                  const Totals& totals,
+                                  const Report& report) {
+  buf.append("\"occurs\":").append(totals.occurs);
+  buf.append(",\"time\":").append(totals.time);
+  if(report.sampleEvent.length())
+    buf.append(",\"samples\":").append(totals.samples);
+  appendJSONLinesCounters(buf, stats, totals.counters, report);
+}
+
+template <typename StatsType>
+static void writeJSONLinesPartitions(Buffer& buf,
+                                     const Report::Entry<StatsType>& entry,
+                                     const Report& report) {
+  if(entry.phases.size()) {
+    buf.append(",\"phases\":[");
+    bool comma = false;
+    for(const auto& phase : entry.phases) {
+      if(comma)
+        buf.append(',');
+      buf.append("{\"phase\":");
+      appendJSON(buf, phase.first);
+      buf.append(',');
+      appendJSONLinesTotals(buf, *entry.stats, phase.second, report);
+      buf.append('}');
+      comma = true;
+    }
+    buf.append(']');
+  }
+
+  if(entry.epochs.size()) {
+    buf.append(",\"epochs\":[");
+    bool comma = false;
+    for(const auto& epoch : entry.epochs) {
+      if(comma)
+        buf.append(',');
+      buf.append("{\"epoch\":").append(epoch.first).append(',');
+      appendJSONLinesTotals(buf, *entry.stats, epoch.second, report);
+      buf.append('}');
+      comma = true;
+    }
+    buf.append(']');
+  }
+}
+
+template <typename StatsType>
+static void writeJSONLinesThreads(Buffer& buf,
+                                  const Report::Entry<StatsType>& entry,
+                                  const Report& report) {
+  buf.append(",\"threads\":[");
+  bool comma = false;
+  for(const ThreadTotals& thread : entry.totals.threads) {
+    if(comma)
+      buf.append(',');
+    buf.append("{\"thread\":").append(thread.thread);
+    buf.append(",\"name\":");
+    appendJSON(buf, report.threads[thread.thread].name);
+    buf.append(",\"occurs\":").append(thread.occurs);
+    buf.append(",\"time\":").append(thread.time);
+    if(report.sampleEvent.length())
+      buf.append(",\"samples\":").append(thread.samples);
+    appendJSONLinesCounters(buf, *entry.stats, thread.counters, report);
+    buf.append('}');
+    comma = true;
+  }
+  buf.append(']');
+
+  if(entry.totals.threads.size() > 1) {
+    const char* what = report.sampleEvent.length() ? "samples" : "time";
+    double maxMean, cv;
+    getImbalance(entry.totals, report, maxMean, cv);
+    buf.append(",\"imbalance\":{\"").append(what).append("_max_mean\":");
+    buf.append(maxMean);
+    buf.append(",\"").append(what).append("_cv\":").append(cv).append('}');
+  }
+}
+
+template <typename StatsType>
+static void writeJSONLinesCommon(Buffer& buf,
+                                 const Report::Entry<StatsType>& entry,
+                                 const Report& report) {
+  buf.append(",\"occurs\":").append(entry.totals.occurs);
+  buf.append(",\"time\":").append(entry.totals.time);
+  if(report.sampleEvent.length())
+    buf.append(",\"samples\":").append(entry.totals.samples);
+  appendJSONLinesCounters(buf, *entry.stats, entry.totals.counters, report);
+
+  const ParallelTotals& parallel = entry.totals.parallel;
+  if(parallel.teams) {
+    buf.append(",\"omp\":{\"teams\":").append(parallel.teams);
+    buf.append(",\"imbalance\":").append(parallel.imbalance);
+    buf.append(",\"barrier_wait\":").append(parallel.barrierWait);
+    buf.append('}');
+  }
+
+  writeJSONLinesPartitions(buf, entry, report);
+  if(report.threads.size() > 1)
+    writeJSONLinesThreads(buf, entry, report);
+  buf.append("}\n");
+}
+
+void JSONLinesOutput::write(Buffer& buf, const Report& report) const {
+  // The IDs are 64-bit hashes. They are written as strings because many
+  // JSON readers cannot represent integers that large exactly
+  for(const Report::Entry<FunctionStats>& entry : report.funcs) {
+    const FunctionStats& stats = *entry.stats;
+    buf.append("{\"kind\":\"function\",\"id\":\"");
+    buf.append(stats.getID()).append("\",\"source\":");
+    appendJSON(buf, stats.getSourceName());
+    buf.append(",\"qualified\":");
+    appendJSON(buf, stats.getQualifiedName());
+    writeJSONLinesCommon(buf, entry, report);
+  }
+
+  for(const Report::Entry<RegionStats>& entry : report.regions) {
+    const RegionStats& stats = *entry.stats;
+    buf.append("{\"kind\":\"region\",\"id\":\"");
+    buf.append(stats.getID()).append("\",\"file\":");
+    appendJSON(buf, stats.getFile());
+    buf.append(",\"start\":").append(stats.getStartLine());
+    buf.append(",\"end\":").append(stats.getEndLine());
+    writeJSONLinesCommon(buf, entry, report);
+  }
+}
+
+// Prometheus
+
+// The labels are left open so more can be added
+static void appendLabels(Buffer& buf, const FunctionStats& stats) {
+  const std::string& name = stats.getSourceName().length()
+                                ? stats.getSourceName()
+                                : stats.getQualifiedName();
+
+  buf.append("{id=\"").append(stats.getID()).append("\",function=");
+  appendLabel(buf, name);
+}
+
+static void appendLabels(Buffer& buf, const RegionStats& stats) {
+  buf.append("{id=\"").append(stats.getID()).append("\",file=");
+  appendLabel(buf, stats.getFile());
+  buf.append(",start=\"").append(stats.getStartLine());
+  buf.append("\",end=\"").append(stats.getEndLine()).append('"');
+}
+
+static void appendFamily(Buffer& buf,
+                         const std::string& name,
+                         const char* help) {
+  buf.append("# HELP ").append(name).append(' ').append(help).append('\n');
+  buf.append("# TYPE ").append(name).append(" counter\n");
+}
+
+template <typename StatsType>
+static void
+writePrometheus(Buffer& buf,
+                const char* kind,
+                const std::vector<Report::Entry<StatsType>>& entries,
+                const Report& report) {
+  if(entries.empty())
+    return;
+
+  std::string prefix = std::string("hwcinstr_") + kind;
+
+  std::string calls = prefix + "_calls_total";
+  appendFamily(buf, calls, "Number of times entered");
+  for(const Report::Entry<StatsType>& entry : entries) {
+    buf.append(calls);
+    appendLabels(buf, *entry.stats);
+    buf.append("} ").append(entry.totals.occurs).append('\n');
+  }
+
+  std::string time = prefix + "_time_nanoseconds_total";
+  appendFamily(buf, time, "Cumulative time spent in nanoseconds");
+  for(const Report::Entry<StatsType>& entry : entries) {
+    buf.append(time);
+    appendLabels(buf, *entry.stats);
+    buf.append("} ").append(entry.totals.time).append('\n');
+  }
+
+  if(report.sampleEvent.length()) {
+    std::string samples = prefix + "_samples_total";
+    appendFamily(buf, samples, "Number of samples taken");
+    for(const Report::Entry<StatsType>& entry : entries) {
+      buf.append(samples);
+      appendLabels(buf, *entry.stats);
+      buf.append(",event=");
+      appendLabel(buf, report.sampleEvent);
+      buf.append("} ").append(entry.totals.samples).append('\n');
+    }
+  }
+
+  std::string counter = prefix + "_counter_total";
+  appendFamily(buf, counter, "Cumulative value of a hardware counter");
+  for(const Report::Entry<StatsType>& entry : entries) {
+    const unsigned* indices = entry.stats->getIndices();
+    for(unsigned i = 0; i < entry.stats->getNumCounters(); i++) {
+      buf.append(counter);
+      appendLabels(buf, *entry.stats);
+      buf.append(",counter=");
+      if(indices[i] < report.counterNames.size())
+        appendLabel(buf, report.counterNames[indices[i]]);
+      else
+        appendLabel(buf, entry.stats->getCounters()[i]);
+      buf.append("} ").append(entry.totals.counters[i]).append('\n');
+    }
+  }
+
+  if(not report.parallel)
+    return;
+
+  struct {
+    const char* suffix;
+    const char* help;
+    int64_t (*get)(const ParallelTotals&);
+  } parallel[] = {
+      {"_omp_teams_total",
+       "Number of OpenMP parallel regions started",
+       [](const ParallelTotals& p) -> int64_t { return p.teams; }},
+      {"_omp_imbalance_nanoseconds_total",
+       "Cumulative load imbalance of the OpenMP teams in nanoseconds",
+       [](const ParallelTotals& p) -> int64_t { return p.imbalance; }},
+      {"_omp_barrier_wait_nanoseconds_total",
+       "Cumulative time spent waiting in OpenMP barriers in nanoseconds",
+       [](const ParallelTotals& p) -> int64_t { return p.barrierWait; }},
+  };
+  for(const auto& family : parallel) {
+    std::string name = prefix + family.suffix;
+    appendFamily(buf, name, family.help);
+    for(const Report::Entry<StatsType>& entry : entries) {
+      if(not entry.totals.parallel.teams)
+        continue;
+      buf.append(name);
+      appendLabels(buf, *entry.stats);
+      buf.append("} ").append(family.get(entry.totals.parallel));
+      buf.append('\n');
+    }
+  }
+}
+
+void PrometheusOutput::write(Buffer& buf, const Report& report) const {
+  writePrometheus(buf, "function", report.funcs, report);
+  writePrometheus(buf, "region", report.regions, report);
+}
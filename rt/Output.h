@@ -0,0 +1,122 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef HWC_OUTPUT_H
+#define HWC_OUTPUT_H
+
+#include "Buffer.h"
+#include "FunctionStats.h"
+#include "RegionStats.h"
+
+#include <sys/types.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// Everything that is written out. This is collected once with the runtime
+// locked so the writers do not need to know anything about the threads or
+// the stats tables
+struct Report {
+  template <typename StatsType>
+  struct Entry {
+    const StatsType* stats;
+    Totals totals;
+
+    // The totals in each phase and each epoch that anything was recorded in.
+    // These are only present if phases were started or the epoch advanced
+    std::vector<std::pair<std::string, Totals>> phases;
+    std::vector<std::pair<unsigned, Totals>> epochs;
+  };
+
+  std::vector<Entry<FunctionStats>> funcs;
+  std::vector<Entry<RegionStats>> regions;
+
+  // The name and the short description of each counter, indexed by
+  // the position of the counter in the per-thread counter set
+  std::vector<std::string> counterNames;
+  std::vector<std::string> counterDescrs;
+
+  // True if any OpenMP parallel regions were recorded
+  bool parallel = false;
+
+  // The threads that recorded anything, indexed by their logical index
+  struct Thread {
+    pid_t tid;
+    std::string name;
+  };
+  std::vector<Thread> threads;
+
+  // The event that was sampled if in sampling mode and the number of
+  // samples that were taken outside any function or region
+  std::string sampleEvent;
+  uint64_t samplePeriod = 0;
+  int64_t unattributed = 0;
+};
+
+class Output {
+public:
+  enum class Format {
+    JSON,
+    CSV,
+    JSONLines,
+    Prometheus,
+  };
+
+public:
+  Output() = default;
+  Output(const Output&) = delete;
+  Output(Output&&) = delete;
+  virtual ~Output() = default;
+
+  virtual void write(Buffer& buf, const Report& report) const = 0;
+
+  // The format is taken from the name if one is given and from the
+  // extension of the output file otherwise. JSON is the default
+  static Format getFormat(const std::string& name, const std::string& file);
+  static std::unique_ptr<Output> create(Format format);
+};
+
+// The nested format that was always written. Functions and regions are
+// keyed by their ID. If more than one thread recorded anything, the values
+// of each thread and the imbalance between them are included
+class JSONOutput : public Output {
+public:
+  virtual void write(Buffer& buf, const Report& report) const override;
+};
+
+// One row per function or region. There is a column for every counter that
+// was recorded by anything. It is left empty for the rows that did not
+// record it
+class CSVOutput : public Output {
+public:
+  virtual void write(Buffer& buf, const Report& report) const override;
+};
+
+// One self-contained JSON object per line. This is easier to stream into
+// other tools than the nested format. The per-thread values are included
+// as they are in the nested format
+class JSONLinesOutput : public Output {
+public:
+  virtual void write(Buffer& buf, const Report& report) const override;
+};
+
+// The text format read by the textfile collector of the Prometheus node
+// exporter
+class PrometheusOutput : public Output {
+public:
+  virtual void write(Buffer& buf, const Report& report) const override;
+};
+
+#endif // HWC_OUTPUT_H
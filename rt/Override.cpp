@@ -0,0 +1,114 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Override.h"
+#include "common/CounterBackend.h"
+
+#include <fnmatch.h>
+
+#include <iostream>
+
+static std::string trim(const std::string& s) {
+  size_t begin = s.find_first_not_of(" \t\r");
+  if(begin == std::string::npos)
+    return "";
+  size_t end = s.find_last_not_of(" \t\r");
+  return s.substr(begin, end - begin + 1);
+}
+
+Override::Override() {
+  ;
+}
+
+bool Override::parse(const std::string& text) {
+  bool valid = true;
+  size_t pos = 0;
+  while(pos < text.length()) {
+    size_t next = text.find_first_of("\n;", pos);
+    std::string line = text.substr(pos, next - pos);
+    pos = (next == std::string::npos) ? next : next + 1;
+
+    std::string rule = trim(line.substr(0, line.find('#')));
+    if(rule.empty())
+      continue;
+
+    Rule parsed = {"", true, false, {}};
+    size_t eq = rule.find('=');
+    if(eq != std::string::npos) {
+      parsed.pattern = trim(rule.substr(0, eq));
+      parsed.replace = true;
+      std::string list = rule.substr(eq + 1);
+      size_t start = 0;
+      while(start <= list.length()) {
+        size_t comma = list.find(',', start);
+        std::string counter = trim(list.substr(start, comma - start));
+        if(counter.length())
+          parsed.counters.push_back(hwc::normalizeCounterName(counter));
+        start = (comma == std::string::npos) ? list.length() + 1 : comma + 1;
+      }
+    } else if(rule[0] == '-' or rule[0] == '+') {
+      parsed.pattern = trim(rule.substr(1));
+      parsed.enable = rule[0] == '+';
+    } else {
+      parsed.pattern = rule;
+    }
+
+    if(parsed.pattern.empty()) {
+      std::cerr << "hwcinstr: Ignoring invalid override rule: " << rule
+                << "\n";
+      valid = false;
+      continue;
+    }
+    rules.push_back(std::move(parsed));
+  }
+
+  return valid;
+}
+
+const Override::Rule*
+Override::find(const std::vector<std::string>& names) const {
+  for(auto rule = rules.rbegin(); rule != rules.rend(); rule++)
+    for(const std::string& name : names)
+      if(fnmatch(rule->pattern.c_str(), name.c_str(), 0) == 0)
+        return &*rule;
+  return nullptr;
+}
+
+bool Override::find(const std::vector<std::string>& names,
+                    bool& enabled,
+                    std::vector<std::string>& counters) const {
+  const Rule* rule = find(names);
+  if(not rule)
+    return false;
+  if(rule->replace)
+    counters = rule->counters;
+  enabled = rule->enable;
+  return true;
+}
+
+bool Override::apply(const hwc::RTFuncMeta& meta,
+                     std::vector<std::string>& counters) const {
+  bool enabled = true;
+  find({meta.qualName, meta.srcName}, enabled, counters);
+  return enabled;
+}
+
+bool Override::apply(const hwc::RTRegionMeta& meta,
+                     std::vector<std::string>& counters) const {
+  bool enabled = true;
+  find({std::string(meta.file) + ":" + std::to_string(meta.startLine)},
+       enabled,
+       counters);
+  return enabled;
+}
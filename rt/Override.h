@@ -0,0 +1,77 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef HWC_OVERRIDE_H
+#define HWC_OVERRIDE_H
+
+#include "common/Types.h"
+
+#include <string>
+#include <vector>
+
+// Changes the functions and regions that are measured and the counters that
+// are recorded for them without recompiling. Each rule starts with a glob
+// pattern that is matched against the qualified and source names of the
+// functions and against the file and line of the start of the regions
+// written as file:line. The last rule that matches wins.
+//
+//   -pattern                   Do not measure
+//   +pattern or pattern        Measure with the counters it was compiled with
+//   pattern = counter, ...     Measure with these counters instead
+//
+// Only the functions and regions that were instrumented when compiling can be
+// measured
+class Override {
+protected:
+  struct Rule {
+    std::string pattern;
+    bool enable;
+    bool replace;
+    std::vector<std::string> counters;
+  };
+
+  std::vector<Rule> rules;
+
+protected:
+  const Rule* find(const std::vector<std::string>& names) const;
+
+public:
+  Override();
+  Override(const Override&) = delete;
+  Override(Override&&) = delete;
+
+  // The rules are separated by newlines or semicolons. Anything after a # on
+  // a line is ignored. Returns false if any of the rules could not be parsed.
+  // The valid rules are still added
+  bool parse(const std::string& text);
+
+  bool empty() const {
+    return rules.empty();
+  }
+
+  // Returns false if none of the rules match any of the names. Otherwise,
+  // enabled is set and the counters are replaced if the rule says so
+  bool find(const std::vector<std::string>& names,
+            bool& enabled,
+            std::vector<std::string>& counters) const;
+
+  // These return false if the function or region should not be measured.
+  // Otherwise, the counters are replaced if a rule says so
+  bool apply(const hwc::RTFuncMeta& meta,
+             std::vector<std::string>& counters) const;
+  bool apply(const hwc::RTRegionMeta& meta,
+             std::vector<std::string>& counters) const;
+};
+
+#endif // HWC_OVERRIDE_H
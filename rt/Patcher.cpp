@@ -0,0 +1,195 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Patcher.h"
+#include "common/API.h"
+
+#include <cpuid.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+
+#define QUOTE_(s) #s
+#define QUOTE(s) QUOTE_(s)
+
+#ifdef __x86_64__
+
+extern "C" void hwcinstr_sled_trampoline();
+
+// The size of the area in which the trampoline saves the extended state. It
+// is set before any sled is patched
+extern "C" [[gnu::visibility("hidden")]] uint64_t hwcinstr_xsave_size;
+uint64_t hwcinstr_xsave_size = 0;
+
+// The patched sled has already clobbered r11 and the flags. Everything else
+// that the handler could clobber is saved here. This includes all of the
+// vector and floating point state because the compiler assumes that it is
+// preserved across the sled, and the handler may call library functions that
+// use any of it. The stack is realigned because the sled may be anywhere in
+// the function and xsave needs a 64-byte aligned area. The bytes of the
+// header of the area that xsave does not write must be zero for xrstor
+asm(R"(
+  .text
+  .p2align 4
+  .globl hwcinstr_sled_trampoline
+  .hidden hwcinstr_sled_trampoline
+  .type hwcinstr_sled_trampoline, @function
+hwcinstr_sled_trampoline:
+  .cfi_startproc
+  endbr64
+  pushq %rbp
+  .cfi_def_cfa_offset 16
+  .cfi_offset %rbp, -16
+  movq %rsp, %rbp
+  .cfi_def_cfa_register %rbp
+  pushq %rax
+  pushq %rcx
+  pushq %rdx
+  pushq %rsi
+  pushq %rdi
+  pushq %r8
+  pushq %r9
+  pushq %r10
+  subq hwcinstr_xsave_size(%rip), %rsp
+  andq $-64, %rsp
+  movq $0, 512(%rsp)
+  movq $0, 520(%rsp)
+  movq $0, 528(%rsp)
+  movq $0, 536(%rsp)
+  movq $0, 544(%rsp)
+  movq $0, 552(%rsp)
+  movq $0, 560(%rsp)
+  movq $0, 568(%rsp)
+  movl $-1, %eax
+  movl $-1, %edx
+  xsave64 (%rsp)
+  movq %r11, %rdi
+  call )" QUOTE(HWC_SLED_HANDLER) R"(@PLT
+  movl $-1, %eax
+  movl $-1, %edx
+  xrstor64 (%rsp)
+  movq -64(%rbp), %r10
+  movq -56(%rbp), %r9
+  movq -48(%rbp), %r8
+  movq -40(%rbp), %rdi
+  movq -32(%rbp), %rsi
+  movq -24(%rbp), %rdx
+  movq -16(%rbp), %rcx
+  movq -8(%rbp), %rax
+  movq %rbp, %rsp
+  .cfi_def_cfa_register %rsp
+  popq %rbp
+  .cfi_def_cfa_offset 8
+  ret
+  .cfi_endproc
+  .size hwcinstr_sled_trampoline, .-hwcinstr_sled_trampoline
+)");
+
+// The size of the area that xsave needs for the components that the OS has
+// enabled. This is 0 if xsave cannot be used, in which case the sleds cannot
+// be patched
+static uint64_t getXSaveSize() {
+  unsigned eax, ebx, ecx, edx;
+  if(not __get_cpuid(1, &eax, &ebx, &ecx, &edx) or not(ecx & bit_OSXSAVE))
+    return 0;
+  if(not __get_cpuid_count(0xd, 0, &eax, &ebx, &ecx, &edx))
+    return 0;
+  return ebx;
+}
+
+// The instruction at the start of the sled is always written with a single
+// two-byte store so a thread executing the sled sees either the old or the
+// new one. The rest of the patched sled is never removed once it has been
+// written, so it does not matter if a thread is in the middle of it when the
+// sled is unpatched
+static constexpr uint16_t Jump = 0x09eb;   // jmp .+11
+static constexpr uint16_t LoadR11 = 0x8d4c; // lea disp32(%rip), %r11
+
+static_assert(offsetof(hwc::RTSled, trampoline) == 0x18,
+              "The patched sled calls the trampoline through the record");
+
+static bool writeSled(hwc::RTSled& sled, bool enable) {
+  auto* code = reinterpret_cast<uint8_t*>(sled.address);
+  auto* head = reinterpret_cast<uint16_t*>(code);
+
+  if(not enable) {
+    __atomic_store_n(head, Jump, __ATOMIC_RELEASE);
+    return true;
+  }
+
+  // The record is in the same executable or shared object as the sled so
+  // it should always be within range
+  int64_t disp = reinterpret_cast<intptr_t>(&sled)
+                 - reinterpret_cast<intptr_t>(code + 7);
+  if(disp < std::numeric_limits<int32_t>::min()
+     or disp > std::numeric_limits<int32_t>::max())
+    return false;
+
+  int32_t disp32 = disp;
+  const uint8_t call[] = {0x41, 0xff, 0x53, 0x18}; // call *0x18(%r11)
+  sled.trampoline = reinterpret_cast<void*>(hwcinstr_sled_trampoline);
+  code[2] = 0x1d;
+  std::memcpy(&code[3], &disp32, sizeof(disp32));
+  std::memcpy(&code[7], call, sizeof(call));
+  __atomic_store_n(head, LoadR11, __ATOMIC_RELEASE);
+  return true;
+}
+
+bool Patcher::patch(const std::vector<hwc::RTSled*>& sleds, bool enable) {
+  if(sleds.empty())
+    return true;
+
+  // This is only written while no sled has been patched, so no thread can
+  // be in the trampoline
+  if(not hwcinstr_xsave_size)
+    hwcinstr_xsave_size = getXSaveSize();
+  if(not hwcinstr_xsave_size)
+    return false;
+
+  // The code of the whole module is made writable at once rather than
+  // calling mprotect for every sled
+  uintptr_t lo = std::numeric_limits<uintptr_t>::max();
+  uintptr_t hi = 0;
+  for(const hwc::RTSled* sled : sleds) {
+    lo = std::min(lo, sled->address);
+    hi = std::max(hi, sled->address + hwc::RTSled::Size);
+  }
+  uintptr_t page = sysconf(_SC_PAGESIZE);
+  lo &= ~(page - 1);
+  hi = (hi + page - 1) & ~(page - 1);
+
+  void* begin = reinterpret_cast<void*>(lo);
+  if(mprotect(begin, hi - lo, PROT_READ | PROT_WRITE | PROT_EXEC))
+    return false;
+
+  bool patched = true;
+  for(hwc::RTSled* sled : sleds)
+    if(not writeSled(*sled, enable))
+      patched = false;
+
+  mprotect(begin, hi - lo, PROT_READ | PROT_EXEC);
+  return patched;
+}
+
+#else // __x86_64__
+
+bool Patcher::patch(const std::vector<hwc::RTSled*>& sleds, bool) {
+  return sleds.empty();
+}
+
+#endif // __x86_64__
@@ -0,0 +1,36 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef HWC_PATCHER_H
+#define HWC_PATCHER_H
+
+#include "common/Types.h"
+
+#include <vector>
+
+// Patches the sleds that are added to the functions when they are
+// instrumented with --sleds. An unpatched sled jumps over itself, so the
+// function runs at close to native speed. A patched sled calls a trampoline
+// that saves the registers that the runtime may clobber and passes the record
+// of the sled to the handler. Sleds can be patched and unpatched while other
+// threads are executing them
+class Patcher {
+public:
+  // Returns false if the code could not be made writable or if sleds are not
+  // supported on this platform or processor. The sleds must all be in the
+  // same executable or shared object
+  static bool patch(const std::vector<hwc::RTSled*>& sleds, bool enable);
+};
+
+#endif // HWC_PATCHER_H
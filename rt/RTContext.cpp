@@ -13,145 +13,903 @@
 // limitations under the License.
 
 #include "RTContext.h"
-#include "common/Formatting.h"
 #include "common/API.h"
 
+#include <fnmatch.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include <sstream>
+#include <unordered_set>
+
+// The bounds of the sections containing the counters to record for each
+// function and region and some source-level metadata to make that output
+// easier to read. Every instrumented module defines this, but the linker
+// keeps only one copy
+extern const hwc::RTMeta HWC_GV_META __attribute__((weak));
 
-// These global variables contain the counters to record for each function and
-// region and some source-level metadata to make that output easier to read
-extern std::byte HWC_GV_META_FUNC __attribute__((weak));
-extern std::byte HWC_GV_NUM_META_FUNC __attribute__((weak));
-extern std::byte HWC_GV_META_REGION __attribute__((weak));
-extern std::byte HWC_GV_NUM_META_REGION __attribute__((weak));
+static std::vector<std::string> splitPatterns(const std::string& spec) {
+  std::vector<std::string> patterns;
+  size_t pos = 0;
+  while(pos < spec.length()) {
+    size_t next = spec.find(',', pos);
+    std::string pattern = spec.substr(pos, next - pos);
+    if(pattern.length())
+      patterns.push_back(pattern);
+    pos = (next == std::string::npos) ? next : next + 1;
+  }
+  return patterns;
+}
 
-RTContext::RTContext() : papiContext(false) {
+RTContext::RTContext()
+    : active(false), indexed(false), numCounters(0), sampleEvent(nullptr),
+      samplePeriod(0), partitions({{"", 0, false}}),
+      partitionIDs({{{"", 0}, 0}}), epoch(0), partition(0), paused(false),
+      control(*this), group(-1) {
+  std::string name;
   if(const char* val = std::getenv("HWCINSTR"))
     output = val;
-  readFuncMeta();
-  readRegionMeta();
+  if(const char* val = std::getenv("HWCINSTR_FORMAT"))
+    name = val;
+  format = Output::getFormat(name, output);
+  if(std::getenv("HWCINSTR_HUGEPAGES"))
+    arena.setHugePages(true);
+  if(const char* val = std::getenv("HWCINSTR_PATCH"))
+    patchSpec = val;
+  else
+    patchSpec = "*";
+  active = output.length();
+  if(const char* val = std::getenv("HWCINSTR_SAMPLE"))
+    if(active)
+      setSampling(val);
+  if(active)
+    setOverride();
+  if(const char* val = std::getenv("HWCINSTR_GROUP"))
+    if(active and not isSampling())
+      setGroup(val);
+  if(const char* val = std::getenv("HWCINSTR_GROUPS_FILE"))
+    groupsFile = val;
+  if(&HWC_GV_META)
+    registerModule(&HWC_GV_META);
+  if(const char* val = std::getenv("HWCINSTR_CONTROL"))
+    if(active and not control.start(val))
+      std::cerr << "hwcinstr: Could not listen for commands on " << val
+                << "\n";
+
+  // The main thread is set up first so that it is always thread 0
+  if(active and syscall(SYS_gettid) == getpid())
+    ThreadContext::get(*this);
 }
 
-RTContext::~RTContext() {
-  print();
+// The spec is the name of the event optionally followed by a colon and the
+// number of events between samples
+void RTContext::setSampling(const std::string& spec) {
+  std::string event = spec.substr(0, spec.find(':'));
+  uint64_t period = DefaultSamplePeriod;
+  if(event.length() < spec.length())
+    period = std::strtoull(spec.c_str() + event.length() + 1, nullptr, 10);
+
+  if(not(sampleEvent = PerfBackend::getEvent(event))) {
+    std::cerr << "hwcinstr: Unknown event to sample " << event << ". "
+              << "Every call will be measured instead\n";
+  } else if(not period or not Sampler::install()) {
+    std::cerr << "hwcinstr: Could not set up sampling. Every call will be "
+              << "measured instead\n";
+    sampleEvent = nullptr;
+  }
+  samplePeriod = period;
 }
 
-const PAPIContext& RTContext::getPAPIContext() const {
-  return papiContext;
+// The rules in the file are applied before those in the environment variable
+void RTContext::setOverride() {
+  if(const char* file = std::getenv("HWCINSTR_OVERRIDE_FILE")) {
+    std::ifstream in(file);
+    std::stringstream ss;
+    if(in and ss << in.rdbuf())
+      override.parse(ss.str());
+    else
+      std::cerr << "hwcinstr: Could not read the overrides in " << file
+                << "\n";
+  }
+  if(const char* val = std::getenv("HWCINSTR_OVERRIDE"))
+    override.parse(val);
+}
+
+void RTContext::setGroup(const std::string& spec) {
+  char* end = nullptr;
+  long val = std::strtol(spec.c_str(), &end, 10);
+  if(spec.empty() or *end or val < 0)
+    std::cerr << "hwcinstr: Invalid group of counters " << spec << ". "
+              << "Every counter will be recorded instead\n";
+  else
+    group = val;
+}
+
+// Must be called with the lock held. The counters of every function and
+// region in the module are put into groups as soon as it is registered.
+// This way, the groups do not depend on the order in which the threads
+// happen to enter the functions
+void RTContext::addGroups(const hwc::RTMeta* meta) {
+  std::vector<std::string> counters;
+  for(const hwc::RTFuncMeta* func = meta->funcsBegin; func < meta->funcsEnd;
+      func++) {
+    counters.assign(func->counters, &func->counters[func->numCounters]);
+    override.apply(*func, counters);
+    for(const std::string& counter : counters)
+      if(hwc::getAllocCounter(counter) < 0)
+        hwc::addToGroup(getBackend(), groups, counter);
+  }
+  for(const hwc::RTRegionMeta* region = meta->regionsBegin;
+      region < meta->regionsEnd;
+      region++) {
+    counters.assign(region->counters,
+                    &region->counters[region->numCounters]);
+    override.apply(*region, counters);
+    for(const std::string& counter : counters)
+      if(hwc::getAllocCounter(counter) < 0)
+        hwc::addToGroup(getBackend(), groups, counter);
+  }
+}
+
+// Must be called with the lock held. Counters that were not seen when the
+// modules were registered, for instance, because they were added when the
+// program was reconfigured, are put into groups here
+void RTContext::selectGroup(std::vector<std::string>& counters) {
+  if(group < 0)
+    return;
+
+  std::vector<std::string> selected;
+  for(const std::string& counter : counters)
+    if(hwc::getAllocCounter(counter) >= 0
+       or hwc::addToGroup(getBackend(), groups, counter) == group)
+      selected.push_back(counter);
+  counters = std::move(selected);
+}
+
+// Each group is written on a separate line as a comma-separated list of
+// counters. This is written even if every counter was recorded so that the
+// number of runs needed to record them all one group at a time is known
+void RTContext::writeGroups() const {
+  std::ofstream out(groupsFile);
+  for(const std::vector<std::string>& counters : groups) {
+    for(size_t i = 0; i < counters.size(); i++)
+      out << (i ? "," : "") << counters[i];
+    out << "\n";
+  }
+  if(not out)
+    std::cerr << "hwcinstr: Could not write the groups of counters to "
+              << groupsFile << "\n";
+}
+
+void RTContext::setSamplingFailed() {
+  std::call_once(sampleWarning, [this]() {
+    std::cerr << "hwcinstr: Could not sample " << sampleEvent->name
+              << " on some threads\n";
+  });
+}
+
+// Must be called with the lock held. A fresh partition is created when the
+// threads must switch even though the phase and epoch have not changed
+void RTContext::setPartition(bool fresh) {
+  std::pair<std::string, unsigned> key(phases.size() ? phases.back() : "",
+                                       epoch);
+  if(paused) {
+    partitions.push_back({key.first, key.second, true});
+    partition.store(partitions.size() - 1, std::memory_order_release);
+    return;
+  }
+
+  if(fresh)
+    partitionIDs.erase(key);
+  auto it = partitionIDs.find(key);
+  if(it == partitionIDs.end()) {
+    it = partitionIDs.emplace(key, partitions.size()).first;
+    partitions.push_back({key.first, key.second, false});
+  }
+  partition.store(it->second, std::memory_order_release);
+}
+
+void RTContext::reset() {
+  std::lock_guard<std::mutex> guard(lock);
+
+  for(Partition& p : partitions)
+    p.discarded = true;
+  partitionIDs.clear();
+  parallel.clear();
+  setPartition(true);
+}
+
+void RTContext::pause() {
+  std::lock_guard<std::mutex> guard(lock);
+
+  if(not paused) {
+    paused = true;
+    setPartition();
+  }
+}
+
+void RTContext::resume() {
+  std::lock_guard<std::mutex> guard(lock);
+
+  if(paused) {
+    paused = false;
+    setPartition();
+  }
+}
+
+void RTContext::snapshot(Buffer& buf) {
+  std::lock_guard<std::mutex> guard(lock);
+
+  Output::create(format)->write(buf, getReport());
 }
 
-void RTContext::readFuncMeta() {
-  if(&HWC_GV_META_FUNC and &HWC_GV_NUM_META_FUNC) {
-    unsigned numFuncs = *reinterpret_cast<unsigned*>(&HWC_GV_NUM_META_FUNC);
-    const auto* funcMeta
-        = reinterpret_cast<const hwc::RTFuncMeta*>(&HWC_GV_META_FUNC);
-    for(unsigned i = 0; i < numFuncs; i++) {
-      const hwc::RTFuncMeta& func = funcMeta[i];
-      FunctionID id = func.id;
-      std::vector<CounterID> counters(func.counters,
-                                      &func.counters[func.numCounters]);
-      std::string srcName = func.srcName;
-      std::string qualName = func.qualName;
-      funcs[id].reset(
-          new FunctionStats(*this, counters, id, srcName, qualName));
+// The new stats are published before the threads are made to switch
+// partitions. When they do, they stop everything they are in using the old
+// stats and restart it with the new ones
+template <typename StatsType>
+bool RTContext::replaceStats(std::unique_ptr<StatsType>& stats,
+                             const std::vector<std::string>& counters,
+                             bool enabled) {
+  std::vector<std::string> selected = counters;
+  selectGroup(selected);
+  Slot slot = {0, 0};
+  if(enabled and not addSlot(selected.size(), slot))
+    return false;
+
+  std::vector<unsigned> indices(selected.size(), 0);
+  if(enabled)
+    indices = addCounters(selected);
+
+  std::unique_ptr<StatsType> next(
+      new StatsType(*stats, selected, indices, slot));
+  if(not enabled)
+    next->disable();
+  next->setPrevious(*stats);
+  stats->setReplacement(*next);
+  retired.emplace_back(std::move(stats));
+  stats = std::move(next);
+  return true;
+}
+
+int RTContext::reconfigure(const std::string& rules) {
+  std::lock_guard<std::mutex> guard(lock);
+
+  Override changes;
+  if(not changes.parse(rules))
+    return -1;
+  override.parse(rules);
+
+  // The counters that the rules do not replace are kept. Functions and
+  // regions that were disabled still have their counters
+  int changed = 0;
+  for(auto& i : funcs) {
+    FunctionStats& stats = *i.second;
+    std::vector<std::string> counters = stats.getCounters();
+    bool enabled = stats.isEnabled();
+    if(isSampling())
+      counters.clear();
+    if(changes.find({stats.getQualifiedName(), stats.getSourceName()},
+                    enabled,
+                    counters)
+       and replaceStats(i.second, counters, enabled)) {
+      funcRegistry.replace(i.first, i.second.get());
+      changed += 1;
+    }
+  }
+  for(auto& i : regions) {
+    RegionStats& stats = *i.second;
+    std::vector<std::string> counters = stats.getCounters();
+    bool enabled = stats.isEnabled();
+    if(isSampling())
+      counters.clear();
+    if(changes.find({stats.getFile() + ":"
+                     + std::to_string(stats.getStartLine())},
+                    enabled,
+                    counters)
+       and replaceStats(i.second, counters, enabled)) {
+      regionRegistry.replace(i.first, i.second.get());
+      changed += 1;
     }
   }
+
+  if(changed)
+    setPartition(true);
+  return changed;
+}
+
+void RTContext::beginPhase(const std::string& name) {
+  std::lock_guard<std::mutex> guard(lock);
+
+  phases.push_back(name);
+  setPartition();
+}
+
+void RTContext::endPhase() {
+  std::lock_guard<std::mutex> guard(lock);
+
+  if(phases.size())
+    phases.pop_back();
+  setPartition();
+}
+
+void RTContext::nextEpoch() {
+  std::lock_guard<std::mutex> guard(lock);
+
+  epoch += 1;
+  setPartition();
+}
+
+// This is called by the constructors of the instrumented shared objects. It
+// may also be called for the executable if some of its modules were
+// compiled as position-independent code. Nothing is read from the metadata
+// here so this is cheap even when there are many instrumented functions
+void RTContext::registerModule(const hwc::RTMeta* meta) {
+  if(not active)
+    return;
+
+  std::lock_guard<std::mutex> guard(lock);
+
+  if(modules.find(meta) != modules.end())
+    return;
+  modules.insert(meta);
+
+  if(indexed)
+    index(meta);
+  if(unknownFuncs.size() or unknownRegions.size())
+    resolveUnknown(meta);
+  if(group >= 0 or groupsFile.length())
+    addGroups(meta);
+
+  unsigned count = 0;
+  if(not patch(meta, splitPatterns(patchSpec), true, count))
+    std::cerr << "hwcinstr: Could not patch the sleds. Functions compiled "
+              << "with --sleds will not be measured\n";
+}
+
+// The stats are not removed here. All the strings in them are copies so they
+// remain valid after the shared object has been unloaded. If the shared
+// object is loaded again, the same stats will continue to be used. The stats
+// of anything in the module that was never entered are created here so that
+// they show up in the output
+void RTContext::unregisterModule(const hwc::RTMeta* meta) {
+  if(not active)
+    return;
+
+  std::lock_guard<std::mutex> guard(lock);
+
+  if(modules.find(meta) == modules.end())
+    return;
+
+  materialize(meta);
+  unindex(meta);
+  modules.erase(meta);
+}
+
+const CounterBackend& RTContext::getBackend() const {
+  std::call_once(backendInit,
+                 [this]() { backend = CounterBackend::create(); });
+  return *backend;
+}
+
+// This is called when a thread could not add a counter. The counter will
+// read as zero on that thread
+void RTContext::setUnavailable(const std::string& counter) {
+  std::lock_guard<std::mutex> guard(lock);
+
+  if(unavailable.insert(counter).second)
+    std::cerr << "hwcinstr: Counter " << counter << " is not available with "
+              << getBackend().getName() << " and will be reported as zero\n";
+}
+
+void RTContext::addParallel(const Stats& stats,
+                            Time imbalance,
+                            Time barrierWait) {
+  RuntimeScope scope;
+  std::lock_guard<std::mutex> guard(lock);
+
+  ParallelTotals& totals = parallel[&stats.getLatest()];
+  totals.teams += 1;
+  totals.imbalance += imbalance;
+  totals.barrierWait += barrierWait;
+}
+
+// There may be more than one record for a function if it was defined in
+// several modules, for instance, inline functions that were not in a
+// COMDAT. They will all have the same ID, so only the first is kept
+void RTContext::index(const hwc::RTMeta* meta) {
+  for(const hwc::RTFuncMeta* func = meta->funcsBegin; func < meta->funcsEnd;
+      func++)
+    funcMeta.emplace(func->id, func);
+  for(const hwc::RTRegionMeta* region = meta->regionsBegin;
+      region < meta->regionsEnd;
+      region++)
+    regionMeta.emplace(region->id, region);
+}
+
+void RTContext::unindex(const hwc::RTMeta* meta) {
+  for(auto i = funcMeta.begin(); i != funcMeta.end();) {
+    if(i->second >= meta->funcsBegin and i->second < meta->funcsEnd)
+      i = funcMeta.erase(i);
+    else
+      i++;
+  }
+  for(auto i = regionMeta.begin(); i != regionMeta.end();) {
+    if(i->second >= meta->regionsBegin and i->second < meta->regionsEnd)
+      i = regionMeta.erase(i);
+    else
+      i++;
+  }
 }
 
-void RTContext::readRegionMeta() {
-  if(&HWC_GV_META_REGION and &HWC_GV_NUM_META_REGION) {
-    unsigned numRegions = *reinterpret_cast<unsigned*>(&HWC_GV_NUM_META_REGION);
-    const auto* regionMeta
-        = reinterpret_cast<const hwc::RTRegionMeta*>(&HWC_GV_META_REGION);
-    for(unsigned i = 0; i < numRegions; i++) {
-      const hwc::RTRegionMeta& region = regionMeta[i];
-      RegionID id = region.id;
-      std::vector<CounterID> counters(region.counters,
-                                      &region.counters[region.numCounters]);
-      std::string file = region.file;
-      unsigned startLine = region.startLine;
-      unsigned endLine = region.endLine;
-      regions[id].reset(
-          new RegionStats(*this, counters, id, file, startLine, endLine));
+// Must be called with the lock held
+bool RTContext::patch(const hwc::RTMeta* meta,
+                      const std::vector<std::string>& patterns,
+                      bool enable,
+                      unsigned& count) {
+  if(meta->sledsBegin == meta->sledsEnd)
+    return true;
+
+  std::unordered_set<FunctionID> selected;
+  std::vector<std::string> counters;
+  for(const hwc::RTFuncMeta* func = meta->funcsBegin; func < meta->funcsEnd;
+      func++) {
+    // The sleds of the functions that have been disabled are never patched
+    if(enable and not override.apply(*func, counters))
+      continue;
+    for(const std::string& pattern : patterns)
+      if(fnmatch(pattern.c_str(), func->qualName, 0) == 0
+         or fnmatch(pattern.c_str(), func->srcName, 0) == 0)
+        if(selected.insert(func->id).second)
+          count += 1;
+  }
+
+  std::vector<hwc::RTSled*> sleds;
+  for(hwc::RTSled* sled = meta->sledsBegin; sled < meta->sledsEnd; sled++)
+    if(selected.count(sled->id))
+      sleds.push_back(sled);
+
+  return Patcher::patch(sleds, enable);
+}
+
+int RTContext::setPatched(const std::string& spec, bool enable) {
+  std::lock_guard<std::mutex> guard(lock);
+
+  unsigned count = 0;
+  bool patched = true;
+  std::vector<std::string> patterns = splitPatterns(spec);
+  for(const hwc::RTMeta* meta : modules)
+    if(not patch(meta, patterns, enable, count))
+      patched = false;
+
+  return patched ? count : -1;
+}
+
+// Must be called with the lock held. The stats of anything in the module
+// that was looked up before the module was registered are created at once
+// so that the placeholders stop hiding it
+void RTContext::resolveUnknown(const hwc::RTMeta* meta) {
+  for(const hwc::RTFuncMeta* func = meta->funcsBegin; func < meta->funcsEnd;
+      func++) {
+    auto it = unknownFuncs.find(func->id);
+    if(it != unknownFuncs.end()
+       and funcRegistry.get(func->id) == it->second.get())
+      createFunctionStats(*func);
+  }
+  for(const hwc::RTRegionMeta* region = meta->regionsBegin;
+      region < meta->regionsEnd;
+      region++) {
+    auto it = unknownRegions.find(region->id);
+    if(it != unknownRegions.end()
+       and regionRegistry.get(region->id) == it->second.get())
+      createRegionStats(*region);
+  }
+}
+
+void RTContext::materialize(const hwc::RTMeta* meta) {
+  for(const hwc::RTFuncMeta* func = meta->funcsBegin; func < meta->funcsEnd;
+      func++)
+    if(not hasFunctionStats(func->id))
+      createFunctionStats(*func);
+  for(const hwc::RTRegionMeta* region = meta->regionsBegin;
+      region < meta->regionsEnd;
+      region++)
+    if(not hasRegionStats(region->id))
+      createRegionStats(*region);
+}
+
+ThreadContext& RTContext::addThread() {
+  std::lock_guard<std::mutex> guard(lock);
+
+  threads.emplace_back(new ThreadContext(*this, arena, threads.size()));
+  return *threads.back();
+}
+
+// Adds any counters that have not been seen before to the per-thread counter
+// set and returns the index of each of the given counters in it. The threads
+// will pick up the new counters the next time they read them
+std::vector<unsigned>
+RTContext::addCounters(const std::vector<std::string>& counters) {
+  std::vector<unsigned> indices;
+  unsigned n = numCounters.load(std::memory_order_relaxed);
+  for(const std::string& counter : counters) {
+    // The allocation counters are not in the counter set. They map to the
+    // extra value that is always zero so that only the allocation hooks add
+    // anything to them
+    if(hwc::getAllocCounter(counter) >= 0) {
+      indices.push_back(ThreadContext::MaxCounters);
+      continue;
     }
+    unsigned i = 0;
+    while(i < n and this->counters[i] != counter)
+      i++;
+    if(i == n and n < ThreadContext::MaxCounters)
+      this->counters[n++] = counter;
+    indices.push_back(i);
   }
+  numCounters.store(n, std::memory_order_release);
+
+  return indices;
 }
 
-bool RTContext::hasFunctionStats(FunctionID id) const {
-  return funcs.find(id) != funcs.end();
+bool RTContext::addSlot(unsigned numCounters, Slot& slot) {
+  if(layout.allocate(numCounters, slot))
+    return true;
+
+  std::call_once(layoutWarning, []() {
+    std::cerr << "hwcinstr: Too many functions and regions. Some will not be "
+              << "recorded\n";
+  });
+  return false;
 }
 
-FunctionStats& RTContext::getFunctionStats(FunctionID id) {
-  return *funcs.at(id);
+// The peak of the live bytes is the largest over the threads and partitions
+// rather than their sum
+static void addCounter(CounterValue& total,
+                       CounterValue value,
+                       const Stats& stats,
+                       unsigned i) {
+  if(stats.getAllocPosition(hwc::AllocCounter::Peak)
+     == static_cast<int>(i))
+    total = std::max(total, value);
+  else
+    total += value;
 }
 
-bool RTContext::hasRegionStats(RegionID id) const {
-  return regions.find(id) != regions.end();
+static Totals makeTotals(const Stats& stats) {
+  return {0,
+          0,
+          0,
+          std::vector<CounterValue>(stats.getNumCounters(), 0),
+          {0, 0, 0},
+          {}};
+}
+
+// Adds the values that a thread recorded in one partition for the stats and
+// for any that they replaced. The values of counters that are not recorded by
+// the current stats are left out. Returns false if the thread never recorded
+// anything for them there
+template <typename TotalsType>
+static bool
+addRecord(TotalsType& totals, const StatsTable* table, const Stats& stats) {
+  if(not table)
+    return false;
+
+  bool recorded = false;
+  for(const Stats* curr = &stats; curr; curr = curr->getPrevious()) {
+    const Record* record = nullptr;
+    if(curr->isEnabled())
+      record = table->findRecord(curr->getSlot());
+    if(not record
+       or (not record->occurs and not record->time and not record->samples))
+      continue;
+
+    const CounterValue* counters = record->getCounters();
+    totals.time += record->time;
+    totals.occurs += record->occurs;
+    totals.samples += record->samples;
+    for(unsigned i = 0; i < curr->getNumCounters(); i++)
+      for(unsigned j = 0; j < stats.getNumCounters(); j++)
+        if(curr->getCounters()[i] == stats.getCounters()[j])
+          addCounter(totals.counters[j], counters[i], stats, j);
+    recorded = true;
+  }
+  return recorded;
 }
 
-RegionStats& RTContext::getRegionStats(RegionID id) {
-  return *regions.at(id);
+// Whether the stats, or any that they replaced, were ever enabled
+static bool isMeasured(const Stats& stats) {
+  for(const Stats* curr = &stats; curr; curr = curr->getPrevious())
+    if(curr->isEnabled())
+      return true;
+  return false;
 }
 
-std::ostream& RTContext::printFunctions(std::ostream& os) const {
-  bool comma = false;
+Totals RTContext::getTotals(const Stats& stats) const {
+  Totals totals = makeTotals(stats);
+  for(const std::unique_ptr<ThreadContext>& tc : threads) {
+    ThreadTotals thread = {tc->getIndex(),
+                           0,
+                           0,
+                           0,
+                           std::vector<CounterValue>(stats.getNumCounters(),
+                                                     0)};
+    bool recorded = false;
+    for(unsigned p = 0; p < partitions.size(); p++)
+      if(not partitions[p].discarded
+         and addRecord(thread, tc->getTable(p), stats))
+        recorded = true;
+    if(not recorded)
+      continue;
 
-  os << tab(1) << quote("functions") << ": {\n";
-  for(const auto& i : funcs) {
-    if(comma)
-      os << ",\n";
-    const FunctionStats& stats = *i.second;
-    stats.print(os);
-    comma = true;
+    totals.time += thread.time;
+    totals.occurs += thread.occurs;
+    totals.samples += thread.samples;
+    for(unsigned i = 0; i < stats.getNumCounters(); i++)
+      addCounter(totals.counters[i], thread.counters[i], stats, i);
+    totals.threads.push_back(std::move(thread));
   }
-  os << "\n" << tab(1) << "}";
 
-  return os;
+  for(const Stats* curr = &stats; curr; curr = curr->getPrevious()) {
+    auto it = parallel.find(curr);
+    if(it != parallel.end()) {
+      totals.parallel.teams += it->second.teams;
+      totals.parallel.imbalance += it->second.imbalance;
+      totals.parallel.barrierWait += it->second.barrierWait;
+    }
+  }
+
+  return totals;
+}
+
+// The totals over some partitions. These do not include the values of each
+// thread
+Totals RTContext::getTotals(const Stats& stats,
+                            const std::vector<unsigned>& partitions) const {
+  Totals totals = makeTotals(stats);
+  for(const std::unique_ptr<ThreadContext>& tc : threads)
+    for(unsigned p : partitions)
+      addRecord(totals, tc->getTable(p), stats);
+
+  return totals;
 }
 
-std::ostream& RTContext::printRegions(std::ostream& os) const {
-  bool comma = false;
+FunctionStats* RTContext::createFunctionStats(const hwc::RTFuncMeta& meta) {
+  FunctionID id = meta.id;
+  std::vector<std::string> counters(meta.counters,
+                                    &meta.counters[meta.numCounters]);
+  bool enabled = override.apply(meta, counters);
+
+  // The counters are not read at all in sampling mode. Disabled functions
+  // never touch the stats tables, so they do not need a slot. Their counters
+  // are kept in case they are enabled later. Functions for which there is no
+  // room are published disabled so that they are not looked up again
+  if(isSampling())
+    counters.clear();
+  selectGroup(counters);
+  Slot slot = {0, 0};
+  if(enabled and not addSlot(counters.size(), slot))
+    enabled = false;
+  std::vector<unsigned> indices(counters.size(), 0);
+  if(enabled)
+    indices = addCounters(counters);
+
+  std::string srcName = meta.srcName;
+  std::string qualName = meta.qualName;
+  funcs[id].reset(
+      new FunctionStats(counters, indices, slot, id, srcName, qualName));
+  if(not enabled)
+    funcs[id]->disable();
+  if(unknownFuncs.count(id))
+    funcRegistry.replace(id, funcs[id].get());
+  else
+    funcRegistry.add(id, funcs[id].get());
+
+  return funcs[id].get();
+}
 
-  os << tab(1) << quote("regions") << ": {\n";
-  for(const auto& i : regions) {
-    if(comma)
-      os << ",\n";
-    const RegionStats& stats = *i.second;
-    stats.print(os);
-    comma = true;
+RegionStats* RTContext::createRegionStats(const hwc::RTRegionMeta& meta) {
+  RegionID id = meta.id;
+  std::vector<std::string> counters(meta.counters,
+                                    &meta.counters[meta.numCounters]);
+  bool enabled = override.apply(meta, counters);
+
+  if(isSampling())
+    counters.clear();
+  selectGroup(counters);
+  Slot slot = {0, 0};
+  if(enabled and not addSlot(counters.size(), slot))
+    enabled = false;
+  std::vector<unsigned> indices(counters.size(), 0);
+  if(enabled)
+    indices = addCounters(counters);
+
+  std::string file = meta.file;
+  unsigned startLine = meta.startLine;
+  unsigned endLine = meta.endLine;
+  regions[id].reset(new RegionStats(counters,
+                                    indices,
+                                    slot,
+                                    id,
+                                    file,
+                                    startLine,
+                                    endLine));
+  if(not enabled)
+    regions[id]->disable();
+  if(unknownRegions.count(id))
+    regionRegistry.replace(id, regions[id].get());
+  else
+    regionRegistry.add(id, regions[id].get());
+
+  return regions[id].get();
+}
+
+// Slow path taken the first time a function is entered
+FunctionStats* RTContext::addFunctionStats(FunctionID id) {
+  RuntimeScope scope;
+  std::lock_guard<std::mutex> guard(lock);
+
+  // Another thread may have gotten here first
+  if(FunctionStats* stats = funcRegistry.get(id))
+    return stats;
+
+  if(not indexed) {
+    for(const hwc::RTMeta* meta : modules)
+      index(meta);
+    indexed = true;
+  }
+
+  auto it = funcMeta.find(id);
+  if(it != funcMeta.end())
+    return createFunctionStats(*it->second);
+
+  std::unique_ptr<FunctionStats>& unknown = unknownFuncs[id];
+  unknown.reset(new FunctionStats({}, {}, {0, 0}, id, "", ""));
+  unknown->disable();
+  funcRegistry.add(id, unknown.get());
+  return unknown.get();
+}
+
+RegionStats* RTContext::addRegionStats(RegionID id) {
+  RuntimeScope scope;
+  std::lock_guard<std::mutex> guard(lock);
+
+  if(RegionStats* stats = regionRegistry.get(id))
+    return stats;
+
+  if(not indexed) {
+    for(const hwc::RTMeta* meta : modules)
+      index(meta);
+    indexed = true;
   }
-  os << "\n" << tab(1) << "}";
 
-  return os;
+  auto it = regionMeta.find(id);
+  if(it != regionMeta.end())
+    return createRegionStats(*it->second);
+
+  std::unique_ptr<RegionStats>& unknown = unknownRegions[id];
+  unknown.reset(new RegionStats({}, {}, {0, 0}, id, "", 0, 0));
+  unknown->disable();
+  regionRegistry.add(id, unknown.get());
+  return unknown.get();
+}
+
+bool RTContext::hasFunctionStats(FunctionID id) const {
+  return funcRegistry.get(id);
+}
+
+// The functions that were disabled at startup or had no room in the tables,
+// and the IDs that have no metadata, are only looked up. Those that were
+// disabled while the program was running must still be exited by any thread
+// that was in them at the time
+FunctionStats* RTContext::getFunctionStats(FunctionID id) {
+  FunctionStats* stats = funcRegistry.get(id);
+  if(not stats)
+    stats = addFunctionStats(id);
+  if(stats and not stats->isEnabled() and not stats->getPrevious())
+    return nullptr;
+  return stats;
 }
 
-void RTContext::print(std::ostream& os) const {
-  os << "{\n";
-  if(funcs.size()) {
-    printFunctions(os);
-    if(regions.size()) {
-      os << ",\n";
-      printRegions(os);
+bool RTContext::hasRegionStats(RegionID id) const {
+  return regionRegistry.get(id);
+}
+
+RegionStats* RTContext::getRegionStats(RegionID id) {
+  RegionStats* stats = regionRegistry.get(id);
+  if(not stats)
+    stats = addRegionStats(id);
+  if(stats and not stats->isEnabled() and not stats->getPrevious())
+    return nullptr;
+  return stats;
+}
+
+Report RTContext::getReport() const {
+  Report report;
+
+  // The phases are only reported if any were started and the epochs only if
+  // there was more than one
+  std::map<std::string, std::vector<unsigned>> byPhase;
+  std::map<unsigned, std::vector<unsigned>> byEpoch;
+  for(unsigned p = 0; p < partitions.size(); p++) {
+    if(partitions[p].discarded)
+      continue;
+    byPhase[partitions[p].phase].push_back(p);
+    byEpoch[partitions[p].epoch].push_back(p);
+  }
+  if(byPhase.size() == 1 and byPhase.begin()->first.empty())
+    byPhase.clear();
+  if(byEpoch.size() == 1)
+    byEpoch.clear();
+
+  auto add = [&](auto& entries, const auto& stats) {
+    entries.emplace_back();
+    auto& entry = entries.back();
+    entry.stats = &stats;
+    entry.totals = getTotals(stats);
+    for(const auto& i : byPhase) {
+      Totals totals = getTotals(stats, i.second);
+      if(totals.occurs or totals.time or totals.samples)
+        entry.phases.emplace_back(i.first, std::move(totals));
     }
-    os << "\n";
-  }
-  os << "}";
-}
-
-void RTContext::print() const {
-  if(output.length()) {
-    if(output == "-") {
-      print(std::cout);
-      std::cout << "\n";
-    } else {
-      std::ofstream of(output.c_str());
-      if(of.is_open()) {
-        print(of);
-        of.close();
-      }
+    for(const auto& i : byEpoch) {
+      Totals totals = getTotals(stats, i.second);
+      if(totals.occurs or totals.time or totals.samples)
+        entry.epochs.emplace_back(i.first, std::move(totals));
     }
+  };
+
+  report.funcs.reserve(funcs.size());
+  for(const auto& i : funcs)
+    if(isMeasured(*i.second))
+      add(report.funcs, *i.second);
+  report.regions.reserve(regions.size());
+  for(const auto& i : regions)
+    if(isMeasured(*i.second))
+      add(report.regions, *i.second);
+
+  report.parallel = parallel.size();
+  for(const std::unique_ptr<ThreadContext>& tc : threads)
+    report.threads.push_back({tc->getTID(), tc->getName()});
+  if(isSampling()) {
+    report.sampleEvent = sampleEvent->name;
+    report.samplePeriod = samplePeriod;
+    for(const std::unique_ptr<ThreadContext>& tc : threads)
+      report.unattributed += tc->getUnattributed();
   }
+
+  const CounterBackend& backend = getBackend();
+  for(unsigned i = 0; i < getNumCounters(); i++) {
+    report.counterNames.push_back(counters[i]);
+    report.counterDescrs.push_back(backend.getDescription(counters[i]));
+  }
+
+  return report;
+}
+
+void RTContext::print() {
+  if(not active)
+    return;
+
+  control.stop();
+
+  std::lock_guard<std::mutex> guard(lock);
+
+  // Anything that was never entered still shows up in the output
+  for(const hwc::RTMeta* meta : modules)
+    materialize(meta);
+
+  Buffer buf;
+  Output::create(format)->write(buf, getReport());
+  if(not buf.write(output))
+    std::cerr << "hwcinstr: Could not write output to " << output << "\n";
+
+  if(group >= 0 and static_cast<size_t>(group) >= groups.size())
+    std::cerr << "hwcinstr: There are only " << groups.size() << " groups "
+              << "of counters. No counters were recorded\n";
+  if(groupsFile.length())
+    writeGroups();
 }
@@ -15,48 +15,258 @@
 #ifndef HWC_RT_CONTEXT_H
 #define HWC_RT_CONTEXT_H
 
+#include "Control.h"
 #include "FunctionStats.h"
+#include "Output.h"
+#include "Override.h"
+#include "Patcher.h"
 #include "RegionStats.h"
-#include "common/PAPIContext.h"
+#include "Registry.h"
+#include "Sampler.h"
+#include "ThreadContext.h"
+#include "common/CounterBackend.h"
 
+#include <map>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_map>
 
 class RTContext {
+public:
+  // The number of events between samples if it is not given
+  static constexpr uint64_t DefaultSamplePeriod = 1000000;
+
 protected:
-  const PAPIContext papiContext;
+  // The runtime stays dormant and does nothing unless the output has been
+  // requested
+  bool active;
+
+  // The backend is only initialized when it is first needed
+  mutable std::unique_ptr<CounterBackend> backend;
+  mutable std::once_flag backendInit;
+
   std::string output;
+  Output::Format format;
   std::map<FunctionID, std::unique_ptr<FunctionStats>> funcs;
   std::map<RegionID, std::unique_ptr<RegionStats>> regions;
 
+  // Used to look up the stats when entering and exiting functions and
+  // regions. These can grow while other threads are using them
+  Registry<FunctionID, FunctionStats> funcRegistry;
+  Registry<RegionID, RegionStats> regionRegistry;
+
+  // The metadata of the executable and shared objects that are currently
+  // loaded. The stats of the functions and regions in a shared object are
+  // kept even after it has been unloaded
+  std::set<const hwc::RTMeta*> modules;
+  mutable std::mutex lock;
+
+  // The metadata records of the modules that are currently loaded. This is
+  // only built when a function or region is entered for the first time. The
+  // stats are only created when they are first needed
+  std::unordered_map<FunctionID, const hwc::RTFuncMeta*> funcMeta;
+  std::unordered_map<RegionID, const hwc::RTRegionMeta*> regionMeta;
+  bool indexed;
+
+  // Disabled stats published for IDs that have no metadata so that looking
+  // them up again does not take the lock. They are replaced in the registry
+  // if a module with the metadata is registered later, but are never freed
+  // because other threads may still be looking at them
+  std::unordered_map<FunctionID, std::unique_ptr<FunctionStats>> unknownFuncs;
+  std::unordered_map<RegionID, std::unique_ptr<RegionStats>> unknownRegions;
+
+  // The accumulators are kept in per-thread stats tables which are
+  // allocated from here
+  Arena arena;
+  StatsLayout layout;
+  std::once_flag layoutWarning;
+  std::vector<std::unique_ptr<ThreadContext>> threads;
+
+  // The counters that have been requested by any function or region. The
+  // index of a counter in here is its index in the per-thread counter set
+  std::array<std::string, ThreadContext::MaxCounters> counters;
+  std::atomic<unsigned> numCounters;
+
+  // The counters that could not be recorded by some thread. A warning is
+  // only printed once for each of them
+  std::set<std::string> unavailable;
+
+  // The OpenMP parallel regions started from each function or region. These
+  // are only recorded when the runtime has been registered as an OpenMP tool
+  std::unordered_map<const Stats*, ParallelTotals> parallel;
+
+  // The event used in sampling mode or nullptr if every call is measured
+  const PerfBackend::Event* sampleEvent;
+  uint64_t samplePeriod;
+  std::once_flag sampleWarning;
+
+  // The accumulators of each phase in each epoch are kept separately. These
+  // are the combinations that have been seen so far. A partition is never
+  // removed once it has been added. Discarded partitions are left out of the
+  // output. Everything is recorded into a discarded partition while the
+  // measurements are paused and every partition is discarded when the
+  // accumulators are reset
+  struct Partition {
+    std::string phase;
+    unsigned epoch;
+    bool discarded;
+  };
+  std::vector<Partition> partitions;
+  std::map<std::pair<std::string, unsigned>, unsigned> partitionIDs;
+
+  // The phases that have been started but not ended. The innermost phase is
+  // the current one
+  std::vector<std::string> phases;
+  unsigned epoch;
+  std::atomic<unsigned> partition;
+  bool paused;
+
+  // The stats that have been replaced because the function or region was
+  // reconfigured while the program was running
+  std::vector<std::unique_ptr<Stats>> retired;
+
+  // The functions whose sleds are patched when a module is registered. This
+  // is a comma-separated list of glob patterns
+  std::string patchSpec;
+
+  // Changes the functions and regions that are measured and their counters
+  Override override;
+
+  // Only listens for commands if a socket has been given
+  Control control;
+
+  // When there are more counters than can be recorded in a single run, they
+  // are split into groups of counters that can be recorded together and
+  // only the selected group is recorded. The groups are found in the same
+  // way on every run, so each run of the program can record a different
+  // group. This is -1 if every counter is recorded
+  int group;
+  std::vector<std::vector<std::string>> groups;
+  std::string groupsFile;
+
 protected:
-  std::ostream& printFunctions(std::ostream& os) const;
-  std::ostream& printRegions(std::ostream& os) const;
+  void setSampling(const std::string& spec);
+  void setOverride();
+  void setGroup(const std::string& spec);
+  void addGroups(const hwc::RTMeta* meta);
+  void selectGroup(std::vector<std::string>& counters);
+  void writeGroups() const;
+  void index(const hwc::RTMeta* meta);
+  void unindex(const hwc::RTMeta* meta);
+  void materialize(const hwc::RTMeta* meta);
+  void resolveUnknown(const hwc::RTMeta* meta);
+  bool patch(const hwc::RTMeta* meta,
+             const std::vector<std::string>& patterns,
+             bool enable,
+             unsigned& count);
+
+  FunctionStats* createFunctionStats(const hwc::RTFuncMeta& meta);
+  RegionStats* createRegionStats(const hwc::RTRegionMeta& meta);
+  FunctionStats* addFunctionStats(FunctionID id);
+  template <typename StatsType>
+  bool replaceStats(std::unique_ptr<StatsType>& stats,
+                    const std::vector<std::string>& counters,
+                    bool enabled);
+  RegionStats* addRegionStats(RegionID id);
 
-  void readFuncMeta();
-  void readRegionMeta();
-  void print(std::ostream& os) const;
+  std::vector<unsigned>
+  addCounters(const std::vector<std::string>& counters);
+  bool addSlot(unsigned numCounters, Slot& slot);
+  void setPartition(bool fresh = false);
+  Totals getTotals(const Stats& stats) const;
+  Totals getTotals(const Stats& stats,
+                   const std::vector<unsigned>& partitions) const;
+  Report getReport() const;
 
 public:
   RTContext();
   RTContext(const RTContext&) = delete;
   RTContext(RTContext&&) = delete;
-  ~RTContext();
+  ~RTContext() = default;
+
+  bool isActive() const {
+    return active;
+  }
+
+  bool isSampling() const {
+    return sampleEvent;
+  }
+
+  const PerfBackend::Event& getSampleEvent() const {
+    return *sampleEvent;
+  }
+
+  uint64_t getSamplePeriod() const {
+    return samplePeriod;
+  }
+
+  // Called when the sampling event could not be opened on a thread
+  void setSamplingFailed();
+
+  // The partition that the accumulators currently go into. This is checked
+  // every time a function or region is entered or exited
+  unsigned getPartition() const {
+    return partition.load(std::memory_order_acquire);
+  }
+
+  void beginPhase(const std::string& name);
+  void endPhase();
+  void nextEpoch();
+
+  void registerModule(const hwc::RTMeta* meta);
+  void unregisterModule(const hwc::RTMeta* meta);
+
+  // Applies override rules to everything that has already been entered as
+  // well as to anything that will be. Returns the number of functions and
+  // regions that were changed or -1 if any of the rules are invalid
+  int reconfigure(const std::string& rules);
+
+  // Discards everything that has been recorded so far
+  void reset();
+
+  // Nothing is recorded while the measurements are paused
+  void pause();
+  void resume();
+
+  // Writes the output for everything recorded so far. The time and the
+  // counters of the functions and regions that are being executed at the
+  // time only include their completed calls, but the calls in progress are
+  // counted in the number of calls
+  void snapshot(Buffer& buf);
+
+  // Patches or unpatches the sleds of the functions whose qualified or
+  // source names match any of the comma-separated patterns. Returns the
+  // number of functions or -1 if any of the sleds could not be patched
+  int setPatched(const std::string& spec, bool enable);
+
+  const CounterBackend& getBackend() const;
+
+  ThreadContext& addThread();
+
+  unsigned getNumCounters() const {
+    return numCounters.load(std::memory_order_acquire);
+  }
+
+  const std::string& getCounter(unsigned i) const {
+    return counters[i];
+  }
 
-  const PAPIContext& getPAPIContext() const;
+  void setUnavailable(const std::string& counter);
 
-  std::string getSourceName(FunctionID id) const;
-  std::string getQualifiedName(FunctionID id) const;
-  std::string getRegionFile(RegionID id) const;
-  unsigned getRegionStart(RegionID id) const;
-  unsigned getRegionEnd(RegionID id) const;
+  // Called when an OpenMP parallel region that was started from within the
+  // stats has ended
+  void addParallel(const Stats& stats, Time imbalance, Time barrierWait);
 
+  // These return nullptr if the ID is not known. This could happen if the
+  // shared object containing the function or region never registered itself
   bool hasFunctionStats(FunctionID id) const;
-  FunctionStats& getFunctionStats(FunctionID id);
+  FunctionStats* getFunctionStats(FunctionID id);
 
   bool hasRegionStats(RegionID id) const;
-  RegionStats& getRegionStats(RegionID id);
+  RegionStats* getRegionStats(RegionID id);
 
-  void print() const;
+  void print();
 };
 
 #endif // HWC_RT_CONTEXT_H
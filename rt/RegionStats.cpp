@@ -13,33 +13,24 @@
 // limitations under the License.
 
 #include "RegionStats.h"
-#include "common/Formatting.h"
 
-RegionStats::RegionStats(RTContext& rt,
-                         const std::vector<CounterID>& counters,
+RegionStats::RegionStats(const std::vector<std::string>& counters,
+                         const std::vector<unsigned>& indices,
+                         Slot slot,
                          RegionID id,
                          const std::string& file,
                          unsigned startLine,
                          unsigned endLine)
-    : Stats(rt, counters), id(id), file(file), startLine(startLine),
+    : Stats(counters, indices, slot), id(id), file(file), startLine(startLine),
       endLine(endLine) {
   ;
 }
 
-std::ostream& RegionStats::print(std::ostream& os) const {
-  os << tab(2) << quote(id) << ": {\n";
-
-  if(file.length()) {
-    if(startLine)
-      os << tab(3) << quote("Start") << ": "
-         << quote(file + std::to_string(startLine)) << "\n";
-    if(endLine)
-      os << tab(3) << quote("End") << ": "
-         << quote(file + std::to_string(endLine)) << "\n";
-  }
-
-  Stats::print(os) << "\n";
-  os << tab(2) << "}\n";
-
-  return os;
+RegionStats::RegionStats(const RegionStats& stats,
+                         const std::vector<std::string>& counters,
+                         const std::vector<unsigned>& indices,
+                         Slot slot)
+    : Stats(counters, indices, slot), id(stats.id), file(stats.file),
+      startLine(stats.startLine), endLine(stats.endLine) {
+  ;
 }
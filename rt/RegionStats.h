@@ -17,8 +17,6 @@
 
 #include "Stats.h"
 
-class RTContext;
-
 class RegionStats : public Stats {
 protected:
   RegionID id;
@@ -27,17 +25,38 @@ protected:
   unsigned endLine;
 
 public:
-  RegionStats(RTContext& rt,
-              const std::vector<CounterID>& counters,
+  RegionStats(const std::vector<std::string>& counters,
+              const std::vector<unsigned>& indices,
+              Slot slot,
               RegionID id,
               const std::string& file,
               unsigned startLine,
               unsigned endLine);
+
+  // The same region recording different counters
+  RegionStats(const RegionStats& stats,
+              const std::vector<std::string>& counters,
+              const std::vector<unsigned>& indices,
+              Slot slot);
   RegionStats(const RegionStats&) = delete;
   RegionStats(RegionStats&&) = delete;
   virtual ~RegionStats() = default;
 
-  virtual std::ostream& print(std::ostream& os) const override;
+  RegionID getID() const {
+    return id;
+  }
+
+  const std::string& getFile() const {
+    return file;
+  }
+
+  unsigned getStartLine() const {
+    return startLine;
+  }
+
+  unsigned getEndLine() const {
+    return endLine;
+  }
 };
 
 #endif // HWC_REGION_STATS_H
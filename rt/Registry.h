@@ -0,0 +1,144 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef HWC_REGISTRY_H
+#define HWC_REGISTRY_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Maps function and region IDs to the objects containing their statistics.
+// Lookups are lock-free and never block, even while new entries are being
+// added from another thread. This matters because shared objects can be
+// loaded while other threads are in the middle of measuring something.
+// Entries are never removed.
+//
+// The IDs are already hashes, so they are used directly to index into an
+// open-addressed table. An ID of 0 is used to indicate an empty slot.
+// When the table gets too full, a larger copy is published. The old tables
+// are kept around because a reader may still be looking at them
+template <typename IDType, typename ValueType>
+class Registry {
+protected:
+  struct Slot {
+    std::atomic<IDType> id;
+    std::atomic<ValueType*> value;
+  };
+
+  struct Table {
+    size_t mask;
+    std::unique_ptr<Slot[]> slots;
+
+    Table(size_t capacity) : mask(capacity - 1), slots(new Slot[capacity]) {
+      for(size_t i = 0; i < capacity; i++) {
+        slots[i].id.store(0, std::memory_order_relaxed);
+        slots[i].value.store(nullptr, std::memory_order_relaxed);
+      }
+    }
+  };
+
+  std::atomic<Table*> table;
+  std::vector<std::unique_ptr<Table>> tables;
+  size_t size;
+
+  // Only needed when adding entries
+  std::mutex lock;
+
+protected:
+  static void insert(Table& table, IDType id, ValueType* value) {
+    for(size_t i = id & table.mask;; i = (i + 1) & table.mask) {
+      Slot& slot = table.slots[i];
+      if(slot.id.load(std::memory_order_relaxed) == 0) {
+        // The value must be visible before the ID is
+        slot.value.store(value, std::memory_order_relaxed);
+        slot.id.store(id, std::memory_order_release);
+        return;
+      }
+    }
+  }
+
+  void grow() {
+    Table& curr = *table.load(std::memory_order_relaxed);
+    size_t capacity = (curr.mask + 1) * 2;
+    tables.emplace_back(new Table(capacity));
+    Table& next = *tables.back();
+    for(size_t i = 0; i <= curr.mask; i++)
+      if(IDType id = curr.slots[i].id.load(std::memory_order_relaxed))
+        insert(next,
+               id,
+               curr.slots[i].value.load(std::memory_order_relaxed));
+    table.store(&next, std::memory_order_release);
+  }
+
+public:
+  Registry(size_t capacity = 1024) : size(0) {
+    tables.emplace_back(new Table(capacity));
+    table.store(tables.back().get(), std::memory_order_relaxed);
+  }
+
+  Registry(const Registry&) = delete;
+  Registry(Registry&&) = delete;
+
+  // Returns nullptr if there is no entry for the ID
+  ValueType* get(IDType id) const {
+    const Table& curr = *table.load(std::memory_order_acquire);
+    for(size_t i = id & curr.mask;; i = (i + 1) & curr.mask) {
+      const Slot& slot = curr.slots[i];
+      IDType found = slot.id.load(std::memory_order_acquire);
+      if(found == id)
+        return slot.value.load(std::memory_order_acquire);
+      else if(found == 0)
+        return nullptr;
+    }
+  }
+
+  // Returns false if there is no entry for the ID. Readers will see either
+  // the old or the new value
+  bool replace(IDType id, ValueType* value) {
+    std::lock_guard<std::mutex> guard(lock);
+
+    Table& curr = *table.load(std::memory_order_relaxed);
+    for(size_t i = id & curr.mask;; i = (i + 1) & curr.mask) {
+      Slot& slot = curr.slots[i];
+      IDType found = slot.id.load(std::memory_order_relaxed);
+      if(found == id) {
+        slot.value.store(value, std::memory_order_release);
+        return true;
+      } else if(found == 0) {
+        return false;
+      }
+    }
+  }
+
+  // Returns false if there already is an entry for the ID
+  bool add(IDType id, ValueType* value) {
+    std::lock_guard<std::mutex> guard(lock);
+
+    if(get(id))
+      return false;
+
+    // Keep the table at most half full so the probe sequences stay short
+    Table* curr = table.load(std::memory_order_relaxed);
+    if((size + 1) * 2 > curr->mask + 1)
+      grow();
+    insert(*table.load(std::memory_order_relaxed), id, value);
+    size += 1;
+
+    return true;
+  }
+};
+
+#endif // HWC_REGISTRY_H
@@ -0,0 +1,98 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Sampler.h"
+#include "ThreadContext.h"
+
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+// This is also used by profilers such as gprof, but they are unlikely to be
+// used together with this
+static constexpr int SampleSignal = SIGPROF;
+
+// The event disables itself after every overflow and is rearmed here. Only
+// async-signal-safe functions may be called
+static void onSample(int, siginfo_t* info, void*) {
+  int saved = errno;
+  if(ThreadContext* tc = ThreadContext::getCurrent())
+    tc->sample();
+  ioctl(info->si_fd, PERF_EVENT_IOC_REFRESH, 1);
+  errno = saved;
+}
+
+Sampler::Sampler() : fd(-1) {
+  ;
+}
+
+Sampler::~Sampler() {
+  stop();
+}
+
+bool Sampler::install() {
+  struct sigaction action;
+  std::memset(&action, 0, sizeof(action));
+  action.sa_sigaction = onSample;
+  action.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  return sigaction(SampleSignal, &action, nullptr) == 0;
+}
+
+bool Sampler::start(const PerfBackend::Event& event,
+                    uint64_t period,
+                    pid_t tid) {
+  struct perf_event_attr attr;
+  std::memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = event.type;
+  attr.config = event.config;
+  attr.sample_period = period;
+  attr.wakeup_events = 1;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+
+  fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+  if(fd < 0)
+    return false;
+
+  // The signal must go to this thread and not just to any thread in the
+  // process
+  struct f_owner_ex owner = {F_OWNER_TID, tid};
+  if(fcntl(fd, F_SETFL, O_ASYNC) < 0 or fcntl(fd, F_SETSIG, SampleSignal) < 0
+     or fcntl(fd, F_SETOWN_EX, &owner) < 0) {
+    stop();
+    return false;
+  }
+
+  ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+  ioctl(fd, PERF_EVENT_IOC_REFRESH, 1);
+  return true;
+}
+
+void Sampler::stop() {
+  if(fd < 0)
+    return;
+
+  ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+  close(fd);
+  fd = -1;
+}
@@ -0,0 +1,47 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef HWC_SAMPLER_H
+#define HWC_SAMPLER_H
+
+#include "common/PerfBackend.h"
+
+#include <sys/types.h>
+
+// Samples a single thread. A signal is delivered to the thread every time the
+// event has occurred the given number of times. The handler attributes the
+// sample to the innermost function or region that the thread is in. The
+// event is opened directly with perf_event_open whichever counter backend
+// is being used for the other counters
+class Sampler {
+protected:
+  int fd;
+
+public:
+  Sampler();
+  Sampler(const Sampler&) = delete;
+  Sampler(Sampler&&) = delete;
+  ~Sampler();
+
+  // Must be called on the thread to be sampled. Returns false if the event
+  // could not be opened
+  bool start(const PerfBackend::Event& event, uint64_t period, pid_t tid);
+  void stop();
+
+  // Installs the signal handler. This must be called once before any thread
+  // is sampled
+  static bool install();
+};
+
+#endif // HWC_SAMPLER_H
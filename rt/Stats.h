@@ -15,55 +15,135 @@
 #ifndef HWC_STATS_H
 #define HWC_STATS_H
 
+#include "StatsTable.h"
+#include "common/CounterBackend.h"
 #include "common/Types.h"
 
-#include <papi.h>
-
-#include <chrono>
-#include <map>
+#include <array>
+#include <atomic>
 #include <vector>
 
-class RTContext;
-
-class Stats {
-protected:
-  RTContext& rt;
-
-  // The PAPI event set that is used to tell PAPI which counters to record
-  int eventSet;
+// The OpenMP parallel regions started from within a function or region.
+// The imbalance of a team is the difference between the longest time that
+// any thread spent working and the mean time over all the threads in it
+struct ParallelTotals {
+  int64_t teams;
+  Time imbalance;
+  Time barrierWait;
+};
 
-  // The start of an interval of time being measured
+// The values accumulated for a function or region by a single thread
+struct ThreadTotals {
+  // The logical index of the thread
+  unsigned thread;
   Time time;
+  int64_t occurs;
+  int64_t samples;
+  std::vector<CounterValue> counters;
+};
 
-  // The number of times the function was called or the number of times the
-  // region was entered
+// The values accumulated for a function or region across all the threads.
+// The threads that never recorded anything for it are not included in the
+// per-thread values
+struct Totals {
+  Time time;
   int64_t occurs;
+  int64_t samples;
+  std::vector<CounterValue> counters;
+  ParallelTotals parallel;
+  std::vector<ThreadTotals> threads;
+};
 
+// The metadata of a function or region. None of this is touched when the
+// function or region is entered or exited except the slot and the indices.
+// The accumulators themselves are in the per-thread stats tables
+class Stats {
+protected:
   // The counters to record for this object
-  const std::vector<CounterID> counters;
+  const std::vector<std::string> counters;
 
-  // Temporary array used when reading counters
-  std::vector<CounterValue> snapshot;
+  // The index of each counter in the per-thread counter set
+  const std::vector<unsigned> indices;
 
-  // The actual counter data
-  std::vector<CounterValue> data;
+  // The position of each of the allocation counters in the counters or -1
+  // if it is not recorded
+  std::array<int, hwc::NumAllocCounters> allocPositions;
+  bool countsAllocs;
 
-protected:
-  Time tick();
+  // The location of the accumulators in the stats tables
+  const Slot slot;
+
+  // Disabled objects are never measured or reported. They are kept so that
+  // looking them up remains cheap
+  bool enabled;
+
+  // A function or region that is reconfigured while the program is running
+  // gets a new object. The old one is never modified or freed because other
+  // threads may still be using it. Each thread moves to the new object the
+  // next time it enters or exits anything
+  const Stats* previous;
+  std::atomic<const Stats*> replacement;
 
 public:
-  Stats(RTContext& papiContext, const std::vector<CounterID>& counters);
+  Stats(const std::vector<std::string>& counters,
+        const std::vector<unsigned>& indices,
+        Slot slot);
   Stats(const Stats&) = delete;
   Stats(const Stats&&) = delete;
   virtual ~Stats() = default;
 
-  void start();
-  void stop();
-  CounterValue get(CounterID) const;
-  Time getTime() const;
-  int64_t getOccurs() const;
-
-  virtual std::ostream& print(std::ostream& os) const;
+  void disable() {
+    enabled = false;
+  }
+
+  bool isEnabled() const {
+    return enabled;
+  }
+
+  // Must be called before the object is published
+  void setPrevious(const Stats& stats) {
+    previous = &stats;
+  }
+
+  void setReplacement(const Stats& stats) {
+    replacement.store(&stats, std::memory_order_release);
+  }
+
+  // Returns nullptr if this has never been reconfigured
+  const Stats* getPrevious() const {
+    return previous;
+  }
+
+  // The object that is currently used for the function or region
+  const Stats& getLatest() const {
+    const Stats* stats = this;
+    while(const Stats* next
+          = stats->replacement.load(std::memory_order_acquire))
+      stats = next;
+    return *stats;
+  }
+
+  Slot getSlot() const {
+    return slot;
+  }
+
+  unsigned getNumCounters() const {
+    return counters.size();
+  }
+
+  const unsigned* getIndices() const {
+    return indices.data();
+  }
+
+  bool isCountingAllocs() const {
+    return countsAllocs;
+  }
+
+  int getAllocPosition(hwc::AllocCounter counter) const {
+    return allocPositions[static_cast<unsigned>(counter)];
+  }
+
+  const std::vector<std::string>& getCounters() const;
 };
 
 #endif // HWC_STATS_H
@@ -0,0 +1,80 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "StatsTable.h"
+
+#include <new>
+
+StatsLayout::StatsLayout() : chunk(0), offset(0) {
+  ;
+}
+
+size_t StatsLayout::getRecordSize(unsigned numCounters) {
+  size_t bytes = sizeof(Record) + numCounters * sizeof(CounterValue);
+  return (bytes + Arena::CacheLineSize - 1) & ~(Arena::CacheLineSize - 1);
+}
+
+bool StatsLayout::allocate(unsigned numCounters, Slot& slot) {
+  size_t bytes = getRecordSize(numCounters);
+  if(bytes > ChunkSize)
+    return false;
+
+  if(offset + bytes > ChunkSize) {
+    chunk += 1;
+    offset = 0;
+  }
+  if(chunk >= MaxChunks)
+    return false;
+
+  slot.chunk = chunk;
+  slot.offset = offset;
+  offset += bytes;
+
+  return true;
+}
+
+StatsTable::StatsTable(Arena& arena) : arena(arena) {
+  for(std::atomic<std::atomic<char*>*>& block : blocks)
+    block.store(nullptr, std::memory_order_relaxed);
+}
+
+char* StatsTable::addChunk(uint32_t chunk) {
+  std::atomic<std::atomic<char*>*>& slot = blocks[chunk / ChunksPerBlock];
+  std::atomic<char*>* block = slot.load(std::memory_order_relaxed);
+  if(not block) {
+    void* mem = arena.allocate(ChunksPerBlock * sizeof(std::atomic<char*>));
+    if(not mem)
+      return nullptr;
+    block = static_cast<std::atomic<char*>*>(mem);
+    for(size_t i = 0; i < ChunksPerBlock; i++)
+      new(&block[i]) std::atomic<char*>(nullptr);
+    slot.store(block, std::memory_order_release);
+  }
+
+  char* base = static_cast<char*>(arena.allocate(StatsLayout::ChunkSize));
+  block[chunk % ChunksPerBlock].store(base, std::memory_order_release);
+  return base;
+}
+
+Record* StatsTable::findRecord(Slot slot) {
+  if(char* base = getChunk(slot.chunk, std::memory_order_acquire))
+    return reinterpret_cast<Record*>(base + slot.offset);
+  return nullptr;
+}
+
+const Record* StatsTable::findRecord(Slot slot) const {
+  if(const char* base = getChunk(slot.chunk, std::memory_order_acquire))
+    return reinterpret_cast<const Record*>(base + slot.offset);
+  return nullptr;
+}
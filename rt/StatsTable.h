@@ -0,0 +1,126 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef HWC_STATS_TABLE_H
+#define HWC_STATS_TABLE_H
+
+#include "Arena.h"
+#include "common/Types.h"
+
+#include <atomic>
+#include <cstdint>
+
+// The location of the accumulators of a function or region in the stats
+// tables. The tables of all the threads have the same layout
+struct Slot {
+  uint32_t chunk;
+  uint32_t offset;
+};
+
+// The accumulators of a single function or region. The counter values follow
+// the fixed fields immediately. Records start on a cache line boundary so
+// the time, the number of occurrences and the first few counters share a
+// single line
+struct Record {
+  // The total time spent
+  Time time;
+
+  // The number of times the function was called or the number of times the
+  // region was entered
+  int64_t occurs;
+
+  // The number of samples taken while this was the innermost function or
+  // region. This is only written by the signal handler of the thread
+  int64_t samples;
+
+  CounterValue* getCounters() {
+    return reinterpret_cast<CounterValue*>(this + 1);
+  }
+
+  const CounterValue* getCounters() const {
+    return reinterpret_cast<const CounterValue*>(this + 1);
+  }
+};
+
+// Assigns slots in the stats tables. The tables are made up of fixed-size
+// chunks and a record never straddles two chunks
+class StatsLayout {
+public:
+  static constexpr size_t ChunkSize = 64 * 1024;
+  static constexpr size_t MaxChunks = 4096;
+
+protected:
+  uint32_t chunk;
+  uint32_t offset;
+
+public:
+  StatsLayout();
+  StatsLayout(const StatsLayout&) = delete;
+  StatsLayout(StatsLayout&&) = delete;
+
+  // Returns false if the tables are full
+  bool allocate(unsigned numCounters, Slot& slot);
+
+  static size_t getRecordSize(unsigned numCounters);
+};
+
+// The accumulators of every function and region for a single thread. The
+// chunks are only allocated when something in them is first touched. The
+// pointers to the chunks are kept in blocks which are also only allocated
+// when needed. This keeps an empty table small, which matters because a
+// thread has one for every phase and epoch
+class StatsTable {
+public:
+  static constexpr size_t ChunksPerBlock = 64;
+  static constexpr size_t MaxBlocks = StatsLayout::MaxChunks / ChunksPerBlock;
+
+protected:
+  Arena& arena;
+  std::atomic<std::atomic<char*>*> blocks[MaxBlocks];
+
+protected:
+  char* addChunk(uint32_t chunk);
+
+  // Only the thread that owns the table adds chunks to it, but any thread
+  // may read it
+  char* getChunk(uint32_t chunk, std::memory_order order) const {
+    const std::atomic<char*>* block
+        = blocks[chunk / ChunksPerBlock].load(order);
+    if(not block)
+      return nullptr;
+    return block[chunk % ChunksPerBlock].load(order);
+  }
+
+public:
+  StatsTable(Arena& arena);
+  StatsTable(const StatsTable&) = delete;
+  StatsTable(StatsTable&&) = delete;
+
+  // Returns nullptr if the memory for the record could not be allocated
+  Record* getRecord(Slot slot) {
+    char* base = getChunk(slot.chunk, std::memory_order_relaxed);
+    if(not base)
+      base = addChunk(slot.chunk);
+    if(not base)
+      return nullptr;
+    return reinterpret_cast<Record*>(base + slot.offset);
+  }
+
+  // Returns nullptr if the record has never been touched. This never
+  // allocates so it can be called from a signal handler
+  const Record* findRecord(Slot slot) const;
+  Record* findRecord(Slot slot);
+};
+
+#endif // HWC_STATS_TABLE_H
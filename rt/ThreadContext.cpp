@@ -0,0 +1,391 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "ThreadContext.h"
+#include "RTContext.h"
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+
+[[gnu::tls_model("initial-exec")]] thread_local ThreadContext*
+    ThreadContext::current
+    = nullptr;
+
+[[gnu::tls_model("initial-exec")]] thread_local bool ThreadContext::internal
+    = false;
+
+// Stops the counters when the thread exits. The context itself is kept
+// because the stats in it are needed for the output
+struct ThreadExit {
+  ThreadContext* tc = nullptr;
+
+  ~ThreadExit() {
+    if(tc)
+      tc->finish();
+  }
+};
+
+static thread_local ThreadExit threadExit;
+
+// This is always called on the thread itself
+ThreadContext::ThreadContext(RTContext& rt, Arena& arena, unsigned index)
+    : rt(rt), arena(arena), partition(0), table(nullptr), index(index),
+      tid(syscall(SYS_gettid)),
+      name(readName(tid)), finished(false), running(false), numCounters(0),
+      depth(0), attached(nullptr), sampling(rt.isSampling()),
+      unattributed(0), liveBytes(0) {
+  calls.frames.reserve(MaxDepth);
+  calls.values.reserve(MaxDepth * 4);
+  positions.fill(-1);
+  base.fill(0);
+  raw.fill(0);
+  values.fill(0);
+  tables.emplace_back(new StatsTable(arena));
+  table = tables.back().get();
+}
+
+ThreadContext& ThreadContext::create(RTContext& rt) {
+  ThreadContext& tc = rt.addThread();
+  current = &tc;
+  threadExit.tc = &tc;
+
+  // The context must be visible to the signal handler before the first
+  // sample can be taken
+  if(tc.sampling
+     and not tc.sampler.start(
+         rt.getSampleEvent(), rt.getSamplePeriod(), tc.tid))
+    rt.setSamplingFailed();
+  return tc;
+}
+
+std::string ThreadContext::readName(pid_t tid) {
+  std::string name;
+  std::ifstream in("/proc/self/task/" + std::to_string(tid) + "/comm");
+  std::getline(in, name);
+  return name;
+}
+
+Time ThreadContext::tick() {
+  auto now = std::chrono::high_resolution_clock::now();
+  return std::chrono::time_point_cast<std::chrono::nanoseconds>(now)
+      .time_since_epoch()
+      .count();
+}
+
+// Adds any counters that have been requested since the last time this was
+// called to the counter set. The counter set has to be stopped to do this
+void ThreadContext::syncCounters() {
+  RuntimeScope scope;
+
+  if(not set)
+    set = rt.getBackend().createSet();
+
+  if(running) {
+    set->stop(raw.data());
+    for(unsigned i = 0; i < numCounters; i++)
+      if(positions[i] >= 0)
+        base[i] += raw[positions[i]];
+  }
+
+  int added = 0;
+  for(unsigned i = 0; i < numCounters; i++)
+    if(positions[i] >= 0)
+      added += 1;
+
+  unsigned n = rt.getNumCounters();
+  for(unsigned i = numCounters; i < n; i++) {
+    if(set->add(rt.getCounter(i)))
+      positions[i] = added++;
+    else
+      rt.setUnavailable(rt.getCounter(i));
+  }
+  numCounters = n;
+
+  running = set->start();
+  raw.fill(0);
+}
+
+const CounterValue* ThreadContext::readCounters() {
+  if(numCounters != rt.getNumCounters())
+    syncCounters();
+
+  if(running)
+    set->read(raw.data());
+  for(unsigned i = 0; i < numCounters; i++)
+    if(positions[i] >= 0)
+      values[i] = base[i] + raw[positions[i]];
+
+  return values.data();
+}
+
+void ThreadContext::startRecord(FrameStack& stack, const Stats& stats) {
+  if(sampling)
+    return;
+
+  // Growing the stack is an allocation made by the runtime itself
+  unsigned n = stats.getNumCounters();
+  if(stack.frames.size() == stack.frames.capacity()
+     or stack.values.size() + n > stack.values.capacity()) {
+    RuntimeScope scope;
+    stack.frames.reserve(2 * stack.frames.capacity() + 1);
+    stack.values.reserve(2 * (stack.values.size() + n));
+  }
+
+  stack.frames.push_back({&stats, tick(), stack.values.size()});
+  if(n) {
+    const CounterValue* values = readCounters();
+    const unsigned* indices = stats.getIndices();
+    for(unsigned i = 0; i < n; i++)
+      stack.values.push_back(values[indices[i]]);
+  }
+}
+
+void ThreadContext::stopRecord(FrameStack& stack,
+                               Record* record,
+                               const Stats& stats) {
+  if(sampling)
+    return;
+
+  // Any frame above the one that is stopped was never exited, for instance
+  // because an exception or a longjmp went through it
+  auto found = std::find_if(stack.frames.rbegin(),
+                            stack.frames.rend(),
+                            [&](const Frame& f) { return f.stats == &stats; });
+  if(found == stack.frames.rend())
+    return;
+  stack.frames.erase(found.base(), stack.frames.end());
+
+  const Frame& frame = stack.frames.back();
+  if(record) {
+    if(unsigned n = stats.getNumCounters()) {
+      const CounterValue* values = readCounters();
+      const unsigned* indices = stats.getIndices();
+      const CounterValue* starts = &stack.values[frame.base];
+      CounterValue* counters = record->getCounters();
+      for(unsigned i = 0; i < n; i++)
+        counters[i] += values[indices[i]] - starts[i];
+    }
+    record->time += tick() - frame.start;
+  }
+  stack.values.resize(frame.base);
+  stack.frames.pop_back();
+}
+
+// The functions and regions that the thread is in when the phase or epoch
+// changes are stopped in the old partition and restarted in the new one, so
+// each partition only gets the time that was spent in it. Only the frames
+// are walked. Nothing is copied between the tables
+void ThreadContext::switchPartition() {
+  RuntimeScope scope;
+
+  unsigned next = rt.getPartition();
+  StatsTable* nextTable = nullptr;
+  {
+    std::lock_guard<std::mutex> guard(tablesLock);
+    if(next >= tables.size())
+      tables.resize(next + 1);
+    if(not tables[next])
+      tables[next].reset(new StatsTable(arena));
+    nextTable = tables[next].get();
+  }
+
+  std::vector<const Stats*> open;
+  while(calls.frames.size()) {
+    const Stats& stats = *calls.frames.back().stats;
+    open.push_back(&stats);
+    stopRecord(calls, getRecord(stats), stats);
+  }
+  if(attached)
+    stopRecord(attachedCalls, getRecord(*attached), *attached);
+
+  partition = next;
+  table = nextTable;
+
+  // Anything that has been reconfigured is restarted with its new stats
+  if(attached) {
+    attached = &attached->getLatest();
+    if(getRecord(*attached))
+      startRecord(attachedCalls, *attached);
+  }
+  for(unsigned i = 0; i < std::min(depth, MaxDepth); i++)
+    stack[i] = &stack[i]->getLatest();
+  for(auto i = open.rbegin(); i != open.rend(); i++) {
+    const Stats& stats = (*i)->getLatest();
+    if(getRecord(stats))
+      startRecord(calls, stats);
+  }
+}
+
+void ThreadContext::checkPartition() {
+  if(partition != rt.getPartition())
+    switchPartition();
+}
+
+void ThreadContext::start(const Stats& entered) {
+  checkPartition();
+
+  // The function or region may have been reconfigured since it was looked
+  // up
+  const Stats& stats = entered.getLatest();
+
+  // The signal handler must never see the depth before the stack has been
+  // updated
+  if(depth < MaxDepth)
+    stack[depth] = &stats;
+  std::atomic_signal_fence(std::memory_order_release);
+  depth += 1;
+
+  Record* record = getRecord(stats);
+  if(not record)
+    return;
+
+  record->occurs += 1;
+  startRecord(calls, stats);
+}
+
+void ThreadContext::stop(const Stats& exited) {
+  checkPartition();
+
+  // If the function or region was enabled while this thread was in it, it
+  // was never entered, so it is not on the stack. Anything above it on the
+  // stack was never exited and is dropped
+  const Stats& stats = exited.getLatest();
+  if(depth and depth <= MaxDepth and stack[depth - 1] != &stats) {
+    unsigned i = depth - 1;
+    while(i and stack[i - 1] != &stats)
+      i--;
+    if(i)
+      depth = i;
+    else if(stats.getPrevious())
+      return;
+  }
+
+  if(depth)
+    depth -= 1;
+
+  stopRecord(calls, getRecord(stats), stats);
+}
+
+// Anything that was still attached is stopped first
+void ThreadContext::attach(const Stats& stats) {
+  checkPartition();
+  if(attached)
+    stopRecord(attachedCalls, getRecord(*attached), *attached);
+  attached = &stats.getLatest();
+  if(getRecord(*attached))
+    startRecord(attachedCalls, *attached);
+}
+
+// The stats that were attached may have been replaced since
+void ThreadContext::detach() {
+  checkPartition();
+  const Stats* stats = attached;
+  attached = nullptr;
+  if(stats)
+    stopRecord(attachedCalls, getRecord(*stats), *stats);
+}
+
+void ThreadContext::sample() {
+  Record* record = nullptr;
+  if(const Stats* stats = getEnclosing())
+    if(stats->isEnabled())
+      record = table->findRecord(stats->getSlot());
+
+  if(record)
+    record->samples += 1;
+  else
+    unattributed.fetch_add(1, std::memory_order_relaxed);
+}
+
+// The record is looked up without allocating anything because this is
+// called from within the allocator. The allocation counters always read as
+// zero when entering and exiting, so they only get what is added here
+void ThreadContext::addAlloc(size_t requested, size_t usable, Time time) {
+  liveBytes += usable;
+
+  const Stats* stats = getEnclosing();
+  if(not stats or not stats->isEnabled() or not stats->isCountingAllocs())
+    return;
+  Record* record = table->findRecord(stats->getSlot());
+  if(not record)
+    return;
+
+  CounterValue* counters = record->getCounters();
+  int pos = stats->getAllocPosition(hwc::AllocCounter::Calls);
+  if(pos >= 0)
+    counters[pos] += 1;
+  if((pos = stats->getAllocPosition(hwc::AllocCounter::Bytes)) >= 0)
+    counters[pos] += requested;
+  if((pos = stats->getAllocPosition(hwc::AllocCounter::Peak)) >= 0)
+    counters[pos] = std::max<CounterValue>(counters[pos], liveBytes);
+  if((pos = stats->getAllocPosition(hwc::AllocCounter::Time)) >= 0)
+    counters[pos] += time;
+}
+
+void ThreadContext::addFree(size_t usable, Time time) {
+  liveBytes -= usable;
+
+  const Stats* stats = getEnclosing();
+  if(not stats or not stats->isEnabled() or not stats->isCountingAllocs())
+    return;
+  int pos = stats->getAllocPosition(hwc::AllocCounter::Time);
+  if(pos < 0)
+    return;
+  if(Record* record = table->findRecord(stats->getSlot()))
+    record->getCounters()[pos] += time;
+}
+
+void ThreadContext::prime() {
+  if(numCounters != rt.getNumCounters())
+    syncCounters();
+}
+
+void ThreadContext::finish() {
+  sampler.stop();
+  if(set) {
+    if(running)
+      set->stop(raw.data());
+    set.reset();
+    running = false;
+  }
+
+  std::string curr = readName(tid);
+  std::lock_guard<std::mutex> guard(nameLock);
+  if(curr.length())
+    name = curr;
+  finished = true;
+}
+
+const StatsTable* ThreadContext::getTable(unsigned partition) const {
+  std::lock_guard<std::mutex> guard(tablesLock);
+  if(partition < tables.size())
+    return tables[partition].get();
+  return nullptr;
+}
+
+// Once the thread has exited, its ID may be reused by another thread so the
+// name is not looked up again
+std::string ThreadContext::getName() const {
+  std::lock_guard<std::mutex> guard(nameLock);
+  if(not finished) {
+    std::string curr = readName(tid);
+    if(curr.length())
+      return curr;
+  }
+  return name;
+}
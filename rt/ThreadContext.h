@@ -0,0 +1,269 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef HWC_THREAD_CONTEXT_H
+#define HWC_THREAD_CONTEXT_H
+
+#include "Sampler.h"
+#include "Stats.h"
+#include "StatsTable.h"
+#include "common/CounterBackend.h"
+
+#include <sys/types.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class RTContext;
+
+// The state of a single thread. Every thread has its own stats table and its
+// own counter set. The counter set contains every counter that any function
+// or region has asked for so far. Counters are read once each time a
+// function or region is entered or exited and the appropriate ones are added
+// to its accumulators.
+//
+// In sampling mode, nothing is timed or read when entering and exiting. Only
+// the stack of functions and regions is maintained and the samples are
+// attributed to whatever is on top of it.
+class ThreadContext {
+public:
+  // The maximum number of distinct counters that can be recorded across all
+  // the functions and regions. Any counter beyond this will read as zero
+  static constexpr unsigned MaxCounters = 64;
+
+  // The maximum depth of nested functions and regions that are tracked.
+  // Anything deeper is still measured but cannot enclose anything
+  static constexpr unsigned MaxDepth = 256;
+
+protected:
+  RTContext& rt;
+  Arena& arena;
+
+  // The stats tables of the phases and epochs that this thread has been in,
+  // indexed by the partition. The lock is only needed when adding a table
+  // and when reading them from another thread
+  std::vector<std::unique_ptr<StatsTable>> tables;
+  mutable std::mutex tablesLock;
+
+  // The partition that the thread is currently recording into
+  unsigned partition;
+  StatsTable* table;
+
+  // The main thread is 0. The other threads are numbered in the order in
+  // which they first entered an instrumented function or region
+  const unsigned index;
+  const pid_t tid;
+
+  // The name of the thread when it exited. While the thread is running, the
+  // name is looked up when it is needed because it may have been changed
+  std::string name;
+  bool finished;
+  mutable std::mutex nameLock;
+
+  // Created by the counter backend the first time a counter is needed
+  std::unique_ptr<CounterSet> set;
+  bool running;
+
+  // The number of counters that have been added to the counter set
+  unsigned numCounters;
+
+  // The position of each counter in the counter set or -1 if it could not be
+  // added
+  std::array<int, MaxCounters> positions;
+
+  // The values accumulated before the counter set was last restarted. The
+  // counters are reset every time the set is started which has to be done
+  // whenever a new counter is added
+  std::array<CounterValue, MaxCounters> base;
+
+  // Temporary arrays used when reading counters. The values array has one
+  // extra element which is always zero for any counter that did not fit
+  std::array<CounterValue, MaxCounters> raw;
+  std::array<CounterValue, MaxCounters + 1> values;
+
+  // The functions and regions that this thread is currently in. This is read
+  // by the signal handler in sampling mode
+  std::array<const Stats*, MaxDepth> stack;
+  unsigned depth;
+
+  // The function or region that the thread is currently working on behalf of
+  // if it was entered on another thread
+  const Stats* attached;
+
+  // The time and the counter values when each call that is being measured
+  // was started. They are only subtracted when the call is stopped, so the
+  // records never contain anything for calls that are still in progress
+  // and can be read at any time. The counter values of all the frames are
+  // kept in a single array
+  struct Frame {
+    const Stats* stats;
+    Time start;
+    size_t base;
+  };
+
+  struct FrameStack {
+    std::vector<Frame> frames;
+    std::vector<CounterValue> values;
+  };
+
+  // The calls on the stack, including any that are too deep to be on it,
+  // and the calls to the attached function or region
+  FrameStack calls;
+  FrameStack attachedCalls;
+
+  const bool sampling;
+  Sampler sampler;
+
+  // The samples that were taken outside any function or region
+  std::atomic<int64_t> unattributed;
+
+  // The bytes allocated on this thread that have not been freed. This only
+  // includes what the allocation hooks saw after the context was created.
+  // It goes down when the thread frees memory allocated by another thread
+  int64_t liveBytes;
+
+  static thread_local ThreadContext* current;
+
+  // Set while the runtime is doing anything on the thread that may allocate
+  // memory. The allocation hooks ignore anything allocated then
+  static thread_local bool internal;
+
+  friend class RuntimeScope;
+
+protected:
+  void syncCounters();
+  const CounterValue* readCounters();
+  void startRecord(FrameStack& stack, const Stats& stats);
+
+  // Stops the innermost frame of the stats. The frames above it are
+  // discarded. Nothing is done if the stats have no frame. The record may be
+  // nullptr if the frame should only be discarded
+  void stopRecord(FrameStack& stack, Record* record, const Stats& stats);
+
+  // Returns nullptr if the stats are disabled or the memory for the record
+  // could not be allocated
+  Record* getRecord(const Stats& stats) {
+    if(not stats.isEnabled())
+      return nullptr;
+    return table->getRecord(stats.getSlot());
+  }
+  void switchPartition();
+
+  static ThreadContext& create(RTContext& rt);
+  static std::string readName(pid_t tid);
+
+public:
+  ThreadContext(RTContext& rt, Arena& arena, unsigned index);
+  ThreadContext(const ThreadContext&) = delete;
+  ThreadContext(ThreadContext&&) = delete;
+
+  void start(const Stats& stats);
+  void stop(const Stats& stats);
+  void finish();
+
+  // These are like start and stop except that the stats are not counted as
+  // having been entered. They are used to attribute the work that a thread
+  // does on behalf of a function that was entered on another thread
+  void attach(const Stats& stats);
+  void detach();
+
+  // Starts the counters before anything is measured on this thread
+  void prime();
+
+  // Threads only notice that the partition has changed when they next enter
+  // or exit something. This makes the thread that changed it switch at once
+  void checkPartition();
+
+  // Called from the signal handler when a sample is taken
+  void sample();
+
+  // Called by the allocation hooks. The allocations are charged to the
+  // innermost function or region if it records any allocation counters
+  bool isCountingAllocs() const {
+    const Stats* stats = getEnclosing();
+    return stats and stats->isCountingAllocs();
+  }
+  void addAlloc(size_t requested, size_t usable, Time time);
+  void addFree(size_t usable, Time time);
+
+  // The innermost function or region that this thread is in or nullptr
+  const Stats* getEnclosing() const {
+    if(depth == 0)
+      return attached;
+    return stack[std::min(depth, MaxDepth) - 1];
+  }
+
+  int64_t getUnattributed() const {
+    return unattributed.load(std::memory_order_relaxed);
+  }
+
+  // Returns nullptr if this thread was never in the partition
+  const StatsTable* getTable(unsigned partition) const;
+
+  unsigned getIndex() const {
+    return index;
+  }
+
+  pid_t getTID() const {
+    return tid;
+  }
+
+  // The name set with pthread_setname_np or prctl
+  std::string getName() const;
+
+  // The context of the calling thread. It is created when the thread first
+  // enters an instrumented function or region, or when the runtime starts
+  // for the main thread
+  static ThreadContext& get(RTContext& rt) {
+    if(ThreadContext* tc = current)
+      return *tc;
+    return create(rt);
+  }
+
+  static Time tick();
+
+  // The context of the calling thread or nullptr if it has not been created
+  static ThreadContext* getCurrent() {
+    return current;
+  }
+
+  static bool isInternal() {
+    return internal;
+  }
+};
+
+// Marks the calling thread as being inside the runtime for as long as this
+// is alive
+class RuntimeScope {
+protected:
+  bool outer;
+
+public:
+  RuntimeScope() : outer(ThreadContext::internal) {
+    ThreadContext::internal = true;
+  }
+  RuntimeScope(const RuntimeScope&) = delete;
+  RuntimeScope(RuntimeScope&&) = delete;
+
+  ~RuntimeScope() {
+    ThreadContext::internal = outer;
+  }
+};
+
+#endif // HWC_THREAD_CONTEXT_H
@@ -0,0 +1,48 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// The interface that programs may use to divide the measurements that are
+// made by the runtime. This can be included from both C and C++
+
+#ifndef HWC_HWCINSTR_H
+#define HWC_HWCINSTR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+// Everything recorded between these is accumulated separately from what is
+// recorded outside. Phases may be nested in which case the innermost one is
+// the one that is current. The name is copied
+void hwcinstr_phase_begin(const char* name);
+void hwcinstr_phase_end(void);
+
+// Start a new epoch. Everything recorded after this is accumulated
+// separately from what was recorded before. This may be called, for
+// instance, at the end of every iteration of a time step loop
+void hwcinstr_epoch_next(void);
+
+// Patch or unpatch the sleds of the functions that were instrumented with
+// --sleds. The functions are selected by a comma-separated list of glob
+// patterns that are matched against their qualified and source names. If
+// this is NULL, all the functions are selected. Returns the number of
+// functions selected or -1 if the code could not be patched
+int hwcinstr_patch(const char* functions);
+int hwcinstr_unpatch(const char* functions);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif // __cplusplus
+
+#endif // HWC_HWCINSTR_H
@@ -0,0 +1,752 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Summarizes and compares the output of instrumented runs. The outputs must
+// be in the CSV or JSON Lines format. Several outputs of the same program
+// are treated as repeated runs and the metrics are averaged over them
+
+#include "Metric.h"
+#include "Statistics.h"
+#include "common/Profile.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+using Profiles = std::vector<std::unique_ptr<Profile>>;
+
+enum class Filter {
+  All,
+  Functions,
+  Regions,
+};
+
+// A condition on the change in a metric between two sets of runs that
+// should cause the tool to fail, for instance time>5% or ipc<-2%
+struct Rule {
+  Metric metric;
+  bool greater;
+  double threshold;
+};
+
+struct Options {
+  // The cost of entering and exiting a function without counters and what
+  // each counter adds to it, in the range measured by the runtime benchmarks
+  // on typical machines. Hardware counters are read in user space, but
+  // software counters need a system call each
+  static constexpr double DefaultProbeCost = 150;
+  static constexpr double HardwareCounterCost = 100;
+  static constexpr double SoftwareCounterCost = 1300;
+
+  // Entries whose time varies by more than this between the merged runs are
+  // reported as inconsistent
+  static constexpr double MaxTimeCV = 0.1;
+
+  std::string command;
+  Metric metric;
+  unsigned top;
+  unsigned depth;
+  unsigned threads;
+  double alpha;
+  Filter filter;
+  std::vector<Rule> rules;
+  bool failUntested;
+  std::vector<std::string> base;
+  std::vector<std::string> files;
+
+  // Used by genconf. The budget is a fraction of the running time and the
+  // cost of a probe is in nanoseconds for each call. If the cost is not
+  // given, it is estimated from the counters. If the running time is not
+  // given, it is taken to be the largest time in the profile
+  double budget;
+  double probeCost;
+  double runtime;
+  std::vector<std::string> counters;
+  std::string output;
+
+  Options()
+      : top(20), depth(1), threads(std::thread::hardware_concurrency()),
+        alpha(0.05), filter(Filter::All), failUntested(false), budget(0.02),
+        probeCost(0), runtime(0), output("-") {
+    if(threads == 0)
+      threads = 1;
+  }
+};
+
+// A row in any of the tables
+struct Row {
+  std::string label;
+  double value;
+  double occurs;
+};
+
+static void printHelp() {
+  std::cout
+      << "Usage: hwc-report <command> [options] <files>...\n"
+      << "\n"
+      << "Commands:\n"
+      << "  top       The functions and regions with the largest metric\n"
+      << "  rollup    The metric summed over namespaces or files\n"
+      << "  diff      The change in the metric between two sets of runs\n"
+      << "  genconf   A config file that instruments the functions with the\n"
+      << "            largest metric within an overhead budget\n"
+      << "  merge     Combines runs that each recorded a different group of\n"
+      << "            counters into a single output with every counter\n"
+      << "\n"
+      << "Options:\n"
+      << "  -m <metric>      Metric to report. This is time, occurs, a\n"
+      << "                   counter, or a ratio such as PAPI_TOT_CYC/occurs\n"
+      << "                   [default: time]\n"
+      << "  -n <num>         Number of rows to show [default: 20]\n"
+      << "  -k <kind>        function, region or all [default: all]\n"
+      << "  -d <depth>       Namespace depth for rollup [default: 1]\n"
+      << "  -j <threads>     Threads used to parse each file\n"
+      << "  -b <file>        Output of a baseline run for diff\n"
+      << "  --alpha <p>      Significance level for diff [default: 0.05]\n"
+      << "  --fail-if <rule> Exit with an error if the change in a metric\n"
+      << "                   matches the rule, for instance time>5%.\n"
+      << "                   Changes that are not significant are ignored,\n"
+      << "                   as are changes that cannot be tested because\n"
+      << "                   there are fewer than two runs on either side\n"
+      << "  --fail-untested  Apply the --fail-if rules to changes that\n"
+      << "                   cannot be tested as well\n"
+      << "  --budget <pct>   Overhead allowed for genconf [default: 2%]\n"
+      << "  --probe-cost <ns>\n"
+      << "                   Cost of each instrumented call [default:\n"
+      << "                   estimated from the counters given with -c]\n"
+      << "  --runtime <ns>   Running time of the program [default: the\n"
+      << "                   largest time in the profile]\n"
+      << "  -c <counter>     Counter to record in the config file\n"
+      << "  -o <file>        Where to write the config file or the merged\n"
+      << "                   output\n";
+}
+
+static bool parseRule(const std::string& spec, Rule& rule) {
+  size_t pos = spec.find_first_of("<>");
+  if(pos == std::string::npos or pos == 0)
+    return false;
+
+  char* end = nullptr;
+  std::string val = spec.substr(pos + 1);
+  rule.metric = Metric(spec.substr(0, pos));
+  rule.greater = (spec[pos] == '>');
+  rule.threshold = std::strtod(val.c_str(), &end);
+  if(end == val.c_str() or (*end and std::string(end) != "%"))
+    return false;
+  rule.threshold /= 100;
+
+  return true;
+}
+
+static bool parseArgs(int argc, char* argv[], Options& opts) {
+  if(argc < 2)
+    return false;
+
+  opts.command = argv[1];
+  for(int i = 2; i < argc; i++) {
+    std::string arg = argv[i];
+    bool hasVal = (i + 1 < argc);
+    if(arg == "-h" or arg == "--help") {
+      return false;
+    } else if(arg == "-m" and hasVal) {
+      opts.metric = Metric(argv[++i]);
+    } else if(arg == "-n" and hasVal) {
+      opts.top = std::strtoul(argv[++i], nullptr, 10);
+    } else if(arg == "-d" and hasVal) {
+      opts.depth = std::strtoul(argv[++i], nullptr, 10);
+    } else if(arg == "-j" and hasVal) {
+      opts.threads = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+    } else if(arg == "-b" and hasVal) {
+      opts.base.push_back(argv[++i]);
+    } else if(arg == "--alpha" and hasVal) {
+      opts.alpha = std::strtod(argv[++i], nullptr);
+    } else if(arg == "--fail-if" and hasVal) {
+      Rule rule;
+      if(not parseRule(argv[++i], rule)) {
+        std::cerr << "hwc-report: Bad rule: " << argv[i] << "\n";
+        return false;
+      }
+      opts.rules.push_back(rule);
+    } else if(arg == "--fail-untested") {
+      opts.failUntested = true;
+    } else if(arg == "--budget" and hasVal) {
+      opts.budget = std::strtod(argv[++i], nullptr) / 100;
+    } else if(arg == "--probe-cost" and hasVal) {
+      opts.probeCost = std::strtod(argv[++i], nullptr);
+    } else if(arg == "--runtime" and hasVal) {
+      opts.runtime = std::strtod(argv[++i], nullptr);
+    } else if(arg == "-c" and hasVal) {
+      opts.counters.push_back(argv[++i]);
+    } else if(arg == "-o" and hasVal) {
+      opts.output = argv[++i];
+    } else if(arg == "-k" and hasVal) {
+      std::string kind = argv[++i];
+      if(kind == "function")
+        opts.filter = Filter::Functions;
+      else if(kind == "region")
+        opts.filter = Filter::Regions;
+      else
+        opts.filter = Filter::All;
+    } else if(arg.length() > 1 and arg[0] == '-') {
+      std::cerr << "hwc-report: Unknown option: " << arg << "\n";
+      return false;
+    } else {
+      opts.files.push_back(arg);
+    }
+  }
+
+  return opts.files.size();
+}
+
+static bool read(const std::vector<std::string>& files,
+                 unsigned threads,
+                 Profiles& profiles) {
+  for(const std::string& file : files) {
+    profiles.emplace_back(new Profile(file));
+    if(not profiles.back()->read(threads))
+      return false;
+  }
+  return true;
+}
+
+static bool accept(const Options& opts, const Entry& entry) {
+  switch(opts.filter) {
+  case Filter::Functions:
+    return entry.kind == Kind::Function;
+  case Filter::Regions:
+    return entry.kind == Kind::Region;
+  default:
+    return true;
+  }
+}
+
+// The values of a metric for an entry in each of the runs in which it could
+// be computed
+static std::vector<double> getValues(const Metric& metric,
+                                     const Profiles& profiles,
+                                     const Profile::Key& key) {
+  std::vector<double> vals;
+  for(const std::unique_ptr<Profile>& profile : profiles) {
+    double val;
+    if(const Entry* entry = profile->getEntry(key))
+      if(metric.eval(*profile, *entry, val))
+        vals.push_back(val);
+  }
+  return vals;
+}
+
+static void printRows(const std::string& header,
+                      std::vector<Row>& rows,
+                      unsigned top) {
+  std::sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) {
+    return a.value > b.value;
+  });
+  if(rows.size() > top)
+    rows.resize(top);
+
+  std::cout << std::setw(18) << header << std::setw(14) << "occurs"
+            << "  name\n";
+  for(const Row& row : rows)
+    std::cout << std::setw(18) << std::setprecision(6) << row.value
+              << std::setw(14) << std::setprecision(6) << row.occurs << "  "
+              << row.label << "\n";
+}
+
+static int top(const Options& opts) {
+  Profiles profiles;
+  if(not read(opts.files, opts.threads, profiles))
+    return 1;
+
+  // The entries that are in any of the runs
+  std::map<Profile::Key, const Entry*> keys;
+  for(const std::unique_ptr<Profile>& profile : profiles)
+    for(const auto& i : profile->getEntries())
+      if(accept(opts, i.second))
+        keys.emplace(i.first, &i.second);
+
+  std::vector<Row> rows;
+  for(const auto& i : keys) {
+    std::vector<double> vals = getValues(opts.metric, profiles, i.first);
+    if(vals.size())
+      rows.push_back({i.second->getLabel(),
+                      mean(vals),
+                      mean(getValues(Metric("occurs"), profiles, i.first))});
+  }
+  printRows(opts.metric.getSpec(), rows, opts.top);
+
+  return 0;
+}
+
+// Splits a qualified name into its components, ignoring any separators
+// within template arguments
+static std::vector<std::string> split(const std::string& name) {
+  std::vector<std::string> parts;
+  int nesting = 0;
+  size_t begin = 0;
+  for(size_t i = 0; i < name.length(); i++) {
+    if(name[i] == '<' or name[i] == '(')
+      nesting++;
+    else if(name[i] == '>' or name[i] == ')')
+      nesting--;
+    else if(nesting == 0 and name.compare(i, 2, "::") == 0) {
+      parts.push_back(name.substr(begin, i - begin));
+      begin = i + 2;
+      i++;
+    }
+  }
+  parts.push_back(name.substr(begin));
+  return parts;
+}
+
+// Functions are grouped by the first few components of the namespaces and
+// classes they are in. Regions are grouped by file
+static std::string getGroup(const Entry& entry, unsigned depth) {
+  if(entry.kind == Kind::Region)
+    return entry.file.length() ? entry.file : "(unknown)";
+
+  std::vector<std::string> parts = split(entry.qualified);
+  if(parts.size() <= 1)
+    return "(global)";
+
+  std::string group;
+  for(size_t i = 0; i < std::min<size_t>(depth, parts.size() - 1); i++)
+    group += (i ? "::" : "") + parts[i];
+  return group;
+}
+
+// The statistics of the entries in a group are added before the metric is
+// computed so that ratios are weighted correctly
+static int rollup(const Options& opts) {
+  Profiles profiles;
+  if(not read(opts.files, opts.threads, profiles))
+    return 1;
+
+  std::map<std::string, std::vector<double>> vals;
+  std::map<std::string, std::vector<double>> occurs;
+  for(const std::unique_ptr<Profile>& profile : profiles) {
+    std::map<std::string, Entry> groups;
+    for(const auto& i : profile->getEntries()) {
+      const Entry& entry = i.second;
+      if(not accept(opts, entry))
+        continue;
+
+      Entry& group = groups[getGroup(entry, opts.depth)];
+      group.occurs += entry.occurs;
+      group.time += entry.time;
+      for(const auto& counter : entry.counters) {
+        auto it = std::find_if(
+            group.counters.begin(),
+            group.counters.end(),
+            [&](const std::pair<unsigned, long long>& c) {
+              return c.first == counter.first;
+            });
+        if(it != group.counters.end())
+          it->second += counter.second;
+        else
+          group.counters.push_back(counter);
+      }
+    }
+
+    for(const auto& i : groups) {
+      double val;
+      if(opts.metric.eval(*profile, i.second, val)) {
+        vals[i.first].push_back(val);
+        occurs[i.first].push_back(i.second.occurs);
+      }
+    }
+  }
+
+  std::vector<Row> rows;
+  for(const auto& i : vals)
+    rows.push_back({i.first, mean(i.second), mean(occurs[i.first])});
+  printRows(opts.metric.getSpec(), rows, opts.top);
+
+  return 0;
+}
+
+struct Change {
+  std::string label;
+  double base;
+  double curr;
+  double change;
+  double p;
+};
+
+// The change in a metric for every entry that is in both sets of runs
+static std::vector<Change> compare(const Options& opts,
+                                   const Metric& metric,
+                                   const Profiles& base,
+                                   const Profiles& curr) {
+  std::map<Profile::Key, const Entry*> keys;
+  for(const std::unique_ptr<Profile>& profile : base)
+    for(const auto& i : profile->getEntries())
+      if(accept(opts, i.second))
+        keys.emplace(i.first, &i.second);
+
+  std::vector<Change> changes;
+  for(const auto& i : keys) {
+    std::vector<double> a = getValues(metric, base, i.first);
+    std::vector<double> b = getValues(metric, curr, i.first);
+    if(a.empty() or b.empty())
+      continue;
+
+    double ma = mean(a);
+    double mb = mean(b);
+    double change = 0;
+    if(ma != 0)
+      change = (mb - ma) / std::fabs(ma);
+    else if(mb != 0)
+      change = HUGE_VAL;
+    changes.push_back({i.second->getLabel(), ma, mb, change, welch(a, b)});
+  }
+
+  return changes;
+}
+
+// With a single run on either side there is nothing to test against, so
+// the p-value is NaN and the change is never significant
+static bool isSignificant(const Change& change, double alpha) {
+  return change.p < alpha;
+}
+
+static int diff(const Options& opts) {
+  if(opts.base.empty()) {
+    std::cerr << "hwc-report: No baseline runs given with -b\n";
+    return 1;
+  }
+
+  Profiles base, curr;
+  if(not read(opts.base, opts.threads, base)
+     or not read(opts.files, opts.threads, curr))
+    return 1;
+
+  std::vector<Change> changes = compare(opts, opts.metric, base, curr);
+  std::sort(changes.begin(),
+            changes.end(),
+            [](const Change& a, const Change& b) {
+              return std::fabs(a.change) > std::fabs(b.change);
+            });
+  if(changes.size() > opts.top)
+    changes.resize(opts.top);
+
+  std::cout << std::setw(14) << "base" << std::setw(14) << "new"
+            << std::setw(10) << "change" << std::setw(10) << "p"
+            << "  name\n";
+  for(const Change& change : changes)
+    std::cout << std::setw(14) << std::setprecision(6) << change.base
+              << std::setw(14) << std::setprecision(6) << change.curr
+              << std::setw(9) << std::setprecision(3) << change.change * 100
+              << "%" << std::setw(10) << std::setprecision(3) << change.p
+              << (isSignificant(change, opts.alpha) ? " *" : "  ")
+              << change.label << "\n";
+
+  int status = 0;
+  unsigned untested = 0;
+  for(const Rule& rule : opts.rules) {
+    for(const Change& change : compare(opts, rule.metric, base, curr)) {
+      bool match = rule.greater ? change.change > rule.threshold
+                                : change.change < rule.threshold;
+      bool tested = not std::isnan(change.p);
+      if(match and not tested and not opts.failUntested)
+        untested += 1;
+      else if(match and (isSignificant(change, opts.alpha) or not tested)) {
+        std::cerr << "hwc-report: " << rule.metric.getSpec() << " changed by "
+                  << std::setprecision(3) << change.change * 100 << "% in "
+                  << change.label << "\n";
+        status = 1;
+      }
+    }
+  }
+  if(untested)
+    std::cerr << "hwc-report: Ignored " << untested << " changes that match "
+              << "the rules but could not be tested. At least two runs are "
+              << "needed on each side, or use --fail-untested\n";
+
+  return status;
+}
+
+// A candidate function for genconf. The config selects functions by their
+// source name, so every function with the same name is included together
+struct Candidate {
+  std::string name;
+  double value;
+  double occurs;
+  std::vector<uint64_t> ids;
+};
+
+// The counters that the kernel counts in software. These are the generic
+// names used by perf, optionally with the perf:: prefix that PAPI uses
+static bool isSoftwareCounter(std::string name) {
+  static const char* const names[] = {"cpu-clock",
+                                      "task-clock",
+                                      "page-faults",
+                                      "faults",
+                                      "minor-faults",
+                                      "major-faults",
+                                      "context-switches",
+                                      "cs",
+                                      "cpu-migrations",
+                                      "migrations",
+                                      "alignment-faults",
+                                      "emulation-faults"};
+  if(name.find("perf::") == 0)
+    name = name.substr(6);
+  std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+  return std::find(std::begin(names), std::end(names), name)
+         != std::end(names);
+}
+
+// The cost given with --probe-cost, or one estimated from the number and the
+// kind of the counters. The allocation counters are kept by the runtime
+// itself, so reading them costs nearly nothing
+static double getProbeCost(const Options& opts) {
+  if(opts.probeCost > 0)
+    return opts.probeCost;
+
+  double cost = Options::DefaultProbeCost;
+  for(const std::string& counter : opts.counters)
+    if(isSoftwareCounter(counter))
+      cost += Options::SoftwareCounterCost;
+    else if(counter.find("alloc-") != 0)
+      cost += Options::HardwareCounterCost;
+  return cost;
+}
+
+// The functions with the largest metric are selected as long as the cost of
+// the calls to them stays within the budget. A function that would exceed it
+// is passed over in favor of smaller ones further down. The time is
+// inclusive, so -m samples on the output of a sampling run ranks the
+// functions by their exclusive cost instead
+static int genconf(const Options& opts) {
+  Profiles profiles;
+  if(not read(opts.files, opts.threads, profiles))
+    return 1;
+
+  std::map<Profile::Key, const Entry*> keys;
+  for(const std::unique_ptr<Profile>& profile : profiles)
+    for(const auto& i : profile->getEntries())
+      if(i.second.kind == Kind::Function)
+        keys.emplace(i.first, &i.second);
+
+  // Calls to other libraries are measured at the call sites and cannot be
+  // selected this way
+  double runtime = opts.runtime;
+  std::map<std::string, Candidate> byName;
+  for(const auto& i : keys) {
+    const std::string& name = i.second->name;
+    double time = mean(getValues(Metric("time"), profiles, i.first));
+    runtime = opts.runtime ? runtime : std::max(runtime, time);
+    std::vector<double> vals = getValues(opts.metric, profiles, i.first);
+    if(vals.empty() or name.empty() or name.find('@') != std::string::npos)
+      continue;
+
+    Candidate& candidate = byName[name];
+    candidate.name = name;
+    candidate.value += mean(vals);
+    candidate.occurs
+        += mean(getValues(Metric("occurs"), profiles, i.first));
+    candidate.ids.push_back(i.first.second);
+  }
+  if(runtime <= 0) {
+    std::cerr << "hwc-report: The running time is not known. Use --runtime\n";
+    return 1;
+  }
+
+  std::vector<Candidate> candidates;
+  for(auto& i : byName)
+    if(i.second.value > 0)
+      candidates.push_back(std::move(i.second));
+  std::sort(candidates.begin(),
+            candidates.end(),
+            [](const Candidate& a, const Candidate& b) {
+              return a.value > b.value;
+            });
+
+  double probeCost = getProbeCost(opts);
+  std::cerr << "hwc-report: Assuming " << probeCost
+            << " ns for each call\n";
+
+  double allowed = opts.budget * runtime;
+  double cost = 0;
+  std::vector<const Candidate*> selected;
+  for(const Candidate& candidate : candidates) {
+    double added = candidate.occurs * probeCost;
+    if(selected.size() < opts.top and cost + added <= allowed) {
+      selected.push_back(&candidate);
+      cost += added;
+    }
+  }
+
+  std::stringstream ss;
+  ss << "---\n"
+     << "# Generated by hwc-report genconf from the largest "
+     << opts.metric.getSpec() << "\n"
+     << "# Estimated overhead " << std::setprecision(3)
+     << cost / runtime * 100 << "% of " << std::setprecision(6) << runtime
+     << " ns at " << probeCost << " ns for each call\n";
+  if(opts.counters.size()) {
+    ss << "counters:\n";
+    for(const std::string& counter : opts.counters)
+      ss << "  - " << counter << "\n";
+  }
+  if(selected.empty())
+    std::cerr << "hwc-report: No function fits in the budget\n";
+  ss << (selected.size() ? "functions:\n" : "functions: []\n");
+  for(const Candidate* candidate : selected) {
+    ss << "  - " << candidate->name << "  # " << std::setprecision(6)
+       << candidate->value << " " << opts.metric.getSpec() << ", "
+       << candidate->occurs << " calls, id";
+    for(uint64_t id : candidate->ids)
+      ss << " " << id;
+    ss << "\n";
+  }
+
+  if(opts.output == "-") {
+    std::cout << ss.str();
+  } else {
+    std::ofstream of(opts.output.c_str());
+    if(not(of << ss.str())) {
+      std::cerr << "hwc-report: Could not write " << opts.output << "\n";
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+static std::string quote(const std::string& s) {
+  std::stringstream ss;
+  ss << '"';
+  for(char c : s) {
+    if(c == '"' or c == '\\')
+      ss << '\\' << c;
+    else if(static_cast<unsigned char>(c) < 0x20)
+      ss << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+         << static_cast<int>(c) << std::dec << std::setfill(' ');
+    else
+      ss << c;
+  }
+  ss << '"';
+  return ss.str();
+}
+
+static double cv(const std::vector<double>& vals) {
+  double m = mean(vals);
+  return m ? std::sqrt(variance(vals)) / m : 0;
+}
+
+// The runs are matched by the kind and ID of the functions and regions. The
+// time and the number of calls are averaged over the runs and each counter
+// is averaged over the runs that recorded it. The counters in the merged
+// output only make sense together if every run did the same work, so the
+// variation of the time and the number of calls between the runs is kept
+// with each entry. The output is in the JSON Lines format and can be read
+// by the other commands
+static int merge(const Options& opts) {
+  Profiles profiles;
+  if(not read(opts.files, opts.threads, profiles))
+    return 1;
+
+  std::map<Profile::Key, const Entry*> keys;
+  for(const std::unique_ptr<Profile>& profile : profiles)
+    for(const auto& i : profile->getEntries())
+      keys.emplace(i.first, &i.second);
+
+  std::stringstream ss;
+  ss << std::setprecision(6);
+  unsigned inconsistent = 0;
+  for(const auto& i : keys) {
+    const Entry& first = *i.second;
+    std::vector<double> occurs = getValues(Metric("occurs"), profiles, i.first);
+    std::vector<double> time = getValues(Metric("time"), profiles, i.first);
+    std::map<std::string, std::vector<double>> counters;
+    for(const std::unique_ptr<Profile>& profile : profiles)
+      if(const Entry* entry = profile->getEntry(i.first))
+        for(const auto& counter : entry->counters)
+          counters[profile->getCounterNames()[counter.first]].push_back(
+              counter.second);
+
+    double occursCV = cv(occurs);
+    double timeCV = cv(time);
+    bool consistent = occurs.size() == profiles.size() and occursCV == 0
+                      and timeCV <= Options::MaxTimeCV;
+    if(not consistent)
+      inconsistent += 1;
+
+    ss << "{\"kind\":"
+       << (first.kind == Kind::Function ? "\"function\"" : "\"region\"")
+       << ",\"id\":\"" << first.id << "\"";
+    if(first.kind == Kind::Function)
+      ss << ",\"source\":" << quote(first.name)
+         << ",\"qualified\":" << quote(first.qualified);
+    else
+      ss << ",\"file\":" << quote(first.file) << ",\"start\":" << first.start
+         << ",\"end\":" << first.end;
+    ss << ",\"occurs\":" << std::llround(mean(occurs))
+       << ",\"time\":" << std::llround(mean(time)) << ",\"counters\":{";
+    for(auto c = counters.begin(); c != counters.end(); c++)
+      ss << (c == counters.begin() ? "" : ",") << quote(c->first) << ":"
+         << std::llround(mean(c->second));
+    ss << "},\"merge\":{\"runs\":" << occurs.size()
+       << ",\"occurs_cv\":" << occursCV << ",\"time_cv\":" << timeCV
+       << ",\"consistent\":" << (consistent ? "true" : "false") << "}}\n";
+  }
+
+  if(inconsistent)
+    std::cerr << "hwc-report: " << inconsistent << " of " << keys.size()
+              << " functions and regions were not measured the same way in "
+              << "every run. Their counters may not be comparable\n";
+
+  if(opts.output == "-") {
+    std::cout << ss.str();
+  } else {
+    std::ofstream of(opts.output.c_str());
+    if(not(of << ss.str())) {
+      std::cerr << "hwc-report: Could not write " << opts.output << "\n";
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  Options opts;
+  if(not parseArgs(argc, argv, opts)) {
+    printHelp();
+    return 1;
+  }
+
+  if(opts.command == "top")
+    return top(opts);
+  else if(opts.command == "rollup")
+    return rollup(opts);
+  else if(opts.command == "diff")
+    return diff(opts);
+  else if(opts.command == "genconf")
+    return genconf(opts);
+  else if(opts.command == "merge")
+    return merge(opts);
+
+  std::cerr << "hwc-report: Unknown command: " << opts.command << "\n";
+  printHelp();
+  return 1;
+}
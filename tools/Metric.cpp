@@ -0,0 +1,61 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Metric.h"
+
+Metric::Metric(const std::string& spec) : spec(spec) {
+  size_t pos = spec.find('/');
+  num = spec.substr(0, pos);
+  if(pos != std::string::npos)
+    denom = spec.substr(pos + 1);
+}
+
+bool Metric::getTerm(const std::string& term,
+                     const Profile& profile,
+                     const Entry& entry,
+                     double& val) {
+  if(term == "time") {
+    val = entry.time;
+    return true;
+  } else if(term == "occurs" or term == "calls") {
+    val = entry.occurs;
+    return true;
+  }
+
+  int id = profile.getCounterID(term);
+  if(id < 0)
+    return false;
+  for(const auto& counter : entry.counters) {
+    if(counter.first == static_cast<unsigned>(id)) {
+      val = counter.second;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Metric::eval(const Profile& profile,
+                  const Entry& entry,
+                  double& val) const {
+  if(not getTerm(num, profile, entry, val))
+    return false;
+  if(denom.empty())
+    return true;
+
+  double d = 0;
+  if(not getTerm(denom, profile, entry, d) or d == 0)
+    return false;
+  val /= d;
+  return true;
+}
@@ -0,0 +1,49 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef HWC_TOOLS_METRIC_H
+#define HWC_TOOLS_METRIC_H
+
+#include "common/Profile.h"
+
+#include <string>
+
+// A quantity that can be computed for a function or region. It is either a
+// single term or the ratio of two terms, for instance PAPI_TOT_CYC/occurs.
+// A term is one of "time", "occurs" or the name of a counter
+class Metric {
+protected:
+  std::string spec;
+  std::string num;
+  std::string denom;
+
+protected:
+  static bool getTerm(const std::string& term,
+                      const Profile& profile,
+                      const Entry& entry,
+                      double& val);
+
+public:
+  Metric(const std::string& spec = "time");
+
+  // Returns false if the metric cannot be computed for the entry because a
+  // counter was not recorded or the denominator is zero
+  bool eval(const Profile& profile, const Entry& entry, double& val) const;
+
+  const std::string& getSpec() const {
+    return spec;
+  }
+};
+
+#endif // HWC_TOOLS_METRIC_H
@@ -0,0 +1,104 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "Statistics.h"
+
+#include <cmath>
+#include <limits>
+
+double mean(const std::vector<double>& vals) {
+  double sum = 0;
+  for(double val : vals)
+    sum += val;
+  return vals.size() ? sum / vals.size() : 0;
+}
+
+double variance(const std::vector<double>& vals) {
+  if(vals.size() < 2)
+    return 0;
+
+  double m = mean(vals);
+  double sum = 0;
+  for(double val : vals)
+    sum += (val - m) * (val - m);
+  return sum / (vals.size() - 1);
+}
+
+// Evaluates the continued fraction for the regularized incomplete beta
+// function using the modified Lentz's method
+static double betacf(double a, double b, double x) {
+  const double eps = 1e-14;
+  const double tiny = 1e-300;
+
+  double c = 1;
+  double d = 1 - (a + b) * x / (a + 1);
+  if(std::fabs(d) < tiny)
+    d = tiny;
+  d = 1 / d;
+  double h = d;
+  for(unsigned m = 1; m <= 300; m++) {
+    double aa = m * (b - m) * x / ((a + 2 * m - 1) * (a + 2 * m));
+    d = 1 + aa * d;
+    c = 1 + aa / c;
+    if(std::fabs(d) < tiny)
+      d = tiny;
+    if(std::fabs(c) < tiny)
+      c = tiny;
+    d = 1 / d;
+    h *= d * c;
+
+    aa = -(a + m) * (a + b + m) * x / ((a + 2 * m) * (a + 2 * m + 1));
+    d = 1 + aa * d;
+    c = 1 + aa / c;
+    if(std::fabs(d) < tiny)
+      d = tiny;
+    if(std::fabs(c) < tiny)
+      c = tiny;
+    d = 1 / d;
+    double delta = d * c;
+    h *= delta;
+    if(std::fabs(delta - 1) < eps)
+      break;
+  }
+  return h;
+}
+
+static double betai(double a, double b, double x) {
+  if(x <= 0)
+    return 0;
+  if(x >= 1)
+    return 1;
+
+  double lbeta = std::lgamma(a + b) - std::lgamma(a) - std::lgamma(b)
+                 + a * std::log(x) + b * std::log(1 - x);
+  if(x < (a + 1) / (a + b + 2))
+    return std::exp(lbeta) * betacf(a, b, x) / a;
+  return 1 - std::exp(lbeta) * betacf(b, a, 1 - x) / b;
+}
+
+double welch(const std::vector<double>& a, const std::vector<double>& b) {
+  if(a.size() < 2 or b.size() < 2)
+    return std::numeric_limits<double>::quiet_NaN();
+
+  double va = variance(a) / a.size();
+  double vb = variance(b) / b.size();
+  double diff = mean(a) - mean(b);
+  if(va + vb == 0)
+    return diff == 0 ? 1 : 0;
+
+  double t = diff / std::sqrt(va + vb);
+  double df = (va + vb) * (va + vb)
+              / (va * va / (a.size() - 1) + vb * vb / (b.size() - 1));
+  return betai(df / 2, 0.5, df / (df + t * t));
+}
@@ -0,0 +1,28 @@
+// Copyright 2020 Tarun Prabhu
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef HWC_TOOLS_STATISTICS_H
+#define HWC_TOOLS_STATISTICS_H
+
+#include <vector>
+
+double mean(const std::vector<double>& vals);
+double variance(const std::vector<double>& vals);
+
+// The two-sided p-value of Welch's t-test for the means of two samples with
+// possibly different variances. Returns NaN if either sample has fewer than
+// two values
+double welch(const std::vector<double>& a, const std::vector<double>& b);
+
+#endif // HWC_TOOLS_STATISTICS_H